@@ -0,0 +1,1316 @@
+#ifndef MICROBIT_HOST_H
+#define MICROBIT_HOST_H
+
+/*
+ * Host-side stand-in for the parts of the micro:bit runtime used by source/main.cpp.
+ *
+ * Sensor input is played back from a script (see host/scripts), and everything written
+ * to the display lands in a virtual 5x5 framebuffer. This lets source/main.cpp build and
+ * run unmodified on Linux:
+ *
+ *   g++ -std=c++11 -O2 -Ihost source/main.cpp -o ubit-sim
+ *   UBIT_SCRIPT=host/scripts/paradox.txt ./ubit-sim
+ *
+ * Environment variables:
+ *   UBIT_SCRIPT   path to a sensor script; without one the board lies flat and still.
+ *   UBIT_DURATION run time in ms when no script is given (default 5000).
+ *   UBIT_TRACE    path to a binary trace recorded by the firmware, played back instead of a script.
+ *   UBIT_SERIAL   file that bytes sent over serial are written to (default stdout).
+ *   UBIT_FRAMES   when set, print the framebuffer every time it changes.
+ *   UBIT_CLOCK    "real" (the default) to run at wall clock speed, or "virtual" to run as fast as the host can.
+ *   UBIT_STORAGE  file standing in for the flash key value store, which keeps its contents between runs.
+ *                 Without one, the store starts empty.
+ *   UBIT_CALIBRATION_MS  how long the user takes to calibrate the compass (default 0, so scripts start with the game).
+ *
+ * The sensors produce samples at their configured period, and raise data-ready events on the
+ * message bus while the firmware sleeps. Reads are counted against the distinct samples they saw,
+ * and the time spent asleep gives the CPU duty cycle.
+ *
+ * The accelerometer is an FXOS8700, as on v1.5 boards, whose FIFO the firmware can program over I2C.
+ * Like the runtime's driver, setting either sensor's period reconfigures the part, and reading either sensor
+ * while the FIFO is on takes a sample out of it.
+ *
+ * On the virtual clock, time only moves when the firmware sleeps or calls into the runtime, which costs
+ * the time the call takes on the board. A long session then replays in however long the logic takes to run.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PI 3.14159265
+
+#define MICROBIT_ID_BUTTON_A 1
+#define MICROBIT_ID_BUTTON_B 2
+#define MICROBIT_ID_BUTTON_AB 3
+#define MICROBIT_ID_ACCELEROMETER 4
+#define MICROBIT_ID_COMPASS 5
+#define MICROBIT_EVT_ANY 0
+#define MICROBIT_BUTTON_EVT_DOWN 1
+#define MICROBIT_BUTTON_EVT_UP 2
+#define MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE 1
+#define MICROBIT_COMPASS_EVT_DATA_UPDATE 1
+#define MICROBIT_SERIAL_DEFAULT_BAUD_RATE 115200
+#define MICROBIT_SERIAL_DEFAULT_BUFFER_SIZE 20
+#define MICROBIT_OK 0
+#define MICROBIT_INVALID_PARAMETER -1001
+#define MICROBIT_NO_RESOURCES -1005
+#define MICROBIT_I2C_ERROR -1010
+#define MICROBIT_NO_DATA -1012
+#define MICROBIT_STORAGE_KEY_SIZE 16
+#define MICROBIT_STORAGE_VALUE_SIZE 32
+#define MICROBIT_STORAGE_ENTRIES 21 // As many pairs as fit in the one flash page the runtime keeps them in
+
+enum MicroBitSerialMode { ASYNC, SYNC_SPINWAIT, SYNC_SLEEP };
+
+struct KeyValuePair {
+    uint8_t key[MICROBIT_STORAGE_KEY_SIZE];
+    uint8_t value[MICROBIT_STORAGE_VALUE_SIZE];
+};
+
+struct CompassSample {
+    int x;
+    int y;
+    int z;
+
+    CompassSample(int x = 0, int y = 0, int z = 0) : x(x), y(y), z(z) {}
+};
+
+struct CompassCalibration {
+    CompassSample centre;
+    CompassSample scale; // 1024 is a scale of 1
+    int radius;
+
+    CompassCalibration() : centre(), scale(1024, 1024, 1024), radius(0) {}
+};
+
+struct MicroBitEvent {
+    uint16_t source;
+    uint16_t value;
+    uint64_t timestamp; // us since power up, when the event was raised
+
+    MicroBitEvent(uint16_t source = 0, uint16_t value = 0) : source(source), value(value), timestamp(0) {}
+};
+
+namespace sim {
+
+/*
+ * A single line of a sensor script.
+ * Sensor values are linearly interpolated between keyframes; buttons hold their state.
+ * heading may exceed 360 so that a spin can be written as 0 -> 720.
+ * Keyframes from a recorded trace carry the raw magnetometer reading in place of a heading.
+ */
+struct Keyframe {
+    unsigned long time;
+    int ax, ay, az;
+    int heading;
+    bool a, b;
+    bool raw;
+    int mx, my, mz;
+};
+
+/*
+ * Decodes a trace streamed by the firmware's TraceRecorder, see source/main.cpp for the format.
+ * Bytes that do not start a record are skipped, and decoding picks up again at the next keyframe.
+ * @return false if the file cannot be read or is not a trace
+ */
+inline bool readTrace(const char *path, std::vector<Keyframe> &trace, unsigned long *skipped = NULL) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) bytes.insert(bytes.end(), chunk, chunk + n);
+    fclose(f);
+    if (bytes.size() < 4 || memcmp(&bytes[0], "UBT\x01", 4) != 0) return false;
+
+    size_t i = 4;
+    bool ok = true;
+    struct Reader {
+        std::vector<uint8_t> const& bytes;
+        size_t &i;
+        bool &ok;
+        uint32_t varint() {
+            uint32_t value = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                if (i >= bytes.size()) break;
+                const uint8_t b = bytes[i++];
+                value |= (uint32_t) (b & 0x7F) << shift;
+                if (!(b & 0x80)) return value;
+            }
+            ok = false;
+            return 0;
+        }
+        int32_t zigzag() {
+            const uint32_t v = varint();
+            return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+        }
+    } reader = {bytes, i, ok};
+
+    Keyframe k = {0, 0, 0, 0, 0, false, false, true, 0, 0, 0};
+    bool synced = false;
+    unsigned long lost = 0;
+    while (i < bytes.size()) {
+        const uint8_t header = bytes[i++];
+        const bool keyframe = header & 0x08;
+        if ((header & 0xF0) != 0x50 || (!synced && !keyframe)) {
+            lost++;
+            continue;
+        }
+        ok = true;
+        Keyframe next = k;
+        next.a = header & 0x01;
+        next.b = header & 0x02;
+        if (keyframe) {
+            next.time = reader.varint();
+            next.ax = reader.zigzag();
+            next.ay = reader.zigzag();
+            next.az = reader.zigzag();
+            next.mx = reader.zigzag();
+            next.my = reader.zigzag();
+            next.mz = reader.zigzag();
+        } else {
+            next.time += reader.varint();
+            next.ax += reader.zigzag();
+            next.ay += reader.zigzag();
+            next.az += reader.zigzag();
+            if (header & 0x04) {
+                next.mx += reader.zigzag();
+                next.my += reader.zigzag();
+                next.mz += reader.zigzag();
+            }
+        }
+        if (!ok) {
+            lost++;
+            synced = false;
+            continue;
+        }
+        k = next;
+        synced = true;
+        trace.push_back(k);
+    }
+    if (skipped) *skipped = lost;
+    return true;
+}
+
+struct Stats {
+    unsigned long accelerometerReads      = 0;
+    unsigned long accelerometerSamples    = 0; // distinct samples among the reads
+    unsigned long compassReads            = 0;
+    unsigned long compassSamples          = 0;
+    unsigned long buttonReads             = 0;
+    unsigned long displayPrints           = 0;
+    unsigned long frameChanges            = 0;
+    unsigned long sleeps                  = 0;
+    unsigned long wakeups                 = 0;
+    unsigned long events                  = 0;
+    unsigned long serialBytes             = 0;
+    unsigned long serialShort             = 0; // asynchronous sends the transmit buffer could not take in full
+    unsigned long i2cTransactions         = 0;
+    unsigned long i2cBytes                = 0;
+    unsigned long calibrations            = 0;
+    unsigned long storageReads            = 0;
+    unsigned long storageWrites           = 0;
+    unsigned long fifoStolen              = 0; // FIFO samples the runtime's driver read before the firmware drained them
+    long firstFrameMs                     = -1;
+    unsigned long buttonEvents            = 0;
+    double accelerometerSampleMs          = 0; // accelerometer samples per ms, summed over every ms run
+    double sleptMs                        = 0;
+};
+
+/*
+ * The UART, which drains its transmit buffer at the baud rate, 10 bits to the byte.
+ * Asynchronous sends only take what fits in the buffer, like the runtime's.
+ */
+struct SerialLine {
+    int baud          = MICROBIT_SERIAL_DEFAULT_BAUD_RATE;
+    int bufferSize    = MICROBIT_SERIAL_DEFAULT_BUFFER_SIZE;
+    double queued     = 0;
+    unsigned long drained = 0;
+    FILE *sink        = NULL;
+
+    void drain(unsigned long t) {
+        queued -= (t - drained) * baud / 10000.0;
+        if (queued < 0) queued = 0;
+        drained = t;
+    }
+};
+
+/*
+ * A sensor that produces a new sample every period ms, like the real parts do at their output data rate.
+ * Reads between samples return the previous sample again.
+ */
+struct SensorTiming {
+    unsigned long period;
+    long lastRead;       // index of the last sample read, -1 before the first
+    long lastAnnounced;  // index of the last sample a data-ready event was raised for
+
+    explicit SensorTiming(unsigned long period) : period(period), lastRead(-1), lastAnnounced(-1) {}
+
+    long index(unsigned long t) const {
+        return (long) (t / period);
+    }
+
+    unsigned long sampleTime(unsigned long t) const {
+        return (t / period) * period;
+    }
+};
+
+/*
+ * Modelled time, in us, that calls into the runtime take on the board.
+ * Only the virtual clock is charged; on the real clock calls take however long the host takes.
+ */
+#define COST_I2C_TRANSACTION_US 240 // Addressing a register, and the runtime's overhead around the transfer
+#define COST_I2C_BYTE_US 60         // Each byte moved
+#define COST_SAMPLE_US (COST_I2C_TRANSACTION_US + 6 * COST_I2C_BYTE_US) // An I2C transfer of a fresh sample from a sensor
+#define COST_READ_US 5     // A reading cached from the last sample, or a GPIO read
+#define COST_DISPLAY_US 30 // Copying an image into the display's buffer
+#define COST_SERIAL_US 10  // Queueing bytes for the UART
+#define COST_EVENT_US 15   // Dispatching an event on the message bus
+#define COST_TIME_US 1     // Reading the system timer
+#define COST_STORAGE_READ_US 20     // Finding a key in the memory mapped flash page
+#define COST_STORAGE_WRITE_US 45000 // Erasing and rewriting the flash page, and the scratch page it is copied through
+
+/*
+ * The simulation's time source. The real clock follows the host's steady clock and sleeps for real.
+ * The virtual clock starts at 0, and only advances by sleeping or spending time.
+ */
+class Clock {
+    private:
+        bool virtualTime = false;
+        uint64_t virtualUs = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    public:
+        void begin(bool useVirtualTime) {
+            virtualTime = useVirtualTime;
+            virtualUs = 0;
+            start = std::chrono::steady_clock::now();
+        }
+
+        bool isVirtual() const {
+            return virtualTime;
+        }
+
+        uint64_t nowUs() const {
+            if (virtualTime) return virtualUs;
+            return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+
+        void spend(uint64_t us) {
+            if (virtualTime) virtualUs += us;
+        }
+
+        // Keeps the CPU busy for us, on either clock.
+        void busy(uint64_t us) {
+            if (virtualTime) {
+                virtualUs += us;
+                return;
+            }
+            const uint64_t until = nowUs() + us;
+            while (nowUs() < until) {}
+        }
+
+        void sleepUntil(unsigned long ms) {
+            if (!virtualTime) {
+                std::this_thread::sleep_until(start + std::chrono::milliseconds(ms));
+            } else if ((uint64_t) ms * 1000 > virtualUs) {
+                virtualUs = (uint64_t) ms * 1000;
+            }
+        }
+
+        // Host time since the clock began, whichever clock the simulation runs on.
+        double hostMs() const {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+};
+
+struct Listener {
+    int id;
+    int value;
+    std::function<void(MicroBitEvent)> handler;
+};
+
+class Simulator {
+    private:
+        std::vector<Keyframe> script;
+        std::vector<Listener> listeners;
+        unsigned long duration = 5000;
+        size_t cursor          = 0;
+        bool printFrames       = false;
+        bool hold              = false; // recorded traces hold each sample rather than interpolating
+        bool running           = false;
+        bool finished          = false;
+        uint8_t framebuffer[25];
+        std::vector<KeyValuePair> storage;
+        const char *storagePath = NULL;
+
+        // The FXOS8700 registers the firmware programs directly, as the runtime leaves them.
+        uint8_t ctrlReg1  = 0x01; // active
+        uint8_t ctrlReg4  = 0x01; // interrupt on every sample
+        uint8_t fifoSetup = 0x00; // FIFO off
+        long fifoNext     = 0;    // index of the oldest sample still in the FIFO
+
+        unsigned long rateSince = 0; // when the accelerometer period last changed
+
+        // Button state as last announced, and the first keyframe that may change it.
+        bool pressedA     = false;
+        bool pressedB     = false;
+        size_t edgeCursor = 0;
+
+        // Another fiber that keeps the CPU busy for loadMs of every loadPeriodMs, or 0 for none.
+        unsigned long loadMs       = 0;
+        unsigned long loadPeriodMs = 0;
+        unsigned long nextLoad     = 0;
+
+        void accountRate() {
+            const unsigned long t = now();
+            stats.accelerometerSampleMs += (double) (t - rateSince) / accelerometer.period;
+            rateSince = t;
+        }
+
+        bool fifoOn() {
+            return (fifoSetup & 0xC0) != 0 && (ctrlReg1 & 0x01) != 0;
+        }
+
+        /*
+         * Samples queued in the FIFO at time t. A circular FIFO that fills up drops its oldest samples.
+         * With the data-ready interrupt on, the runtime's driver reads each sample as it arrives, and in FIFO mode
+         * every read of OUT_X_MSB takes one out, so the firmware finds the FIFO empty.
+         */
+        int fifoQueued(unsigned long t) {
+            if (!fifoOn()) return 0;
+            const long newest = accelerometer.index(t);
+            if (newest - fifoNext + 1 > 32) fifoNext = newest - 31;
+            if (ctrlReg4 & 0x01) {
+                stats.fifoStolen += newest - fifoNext + 1;
+                fifoNext = newest + 1;
+            }
+            return (int) (newest - fifoNext + 1);
+        }
+
+        static void putSample(uint8_t *bytes, int milliG) {
+            long counts = (long) milliG * 4096 / 1000;
+            if (counts > 8191) counts = 8191;
+            if (counts < -8192) counts = -8192;
+            const uint16_t word = (uint16_t) (counts * 4);
+            bytes[0] = (uint8_t) (word >> 8);
+            bytes[1] = (uint8_t) word;
+        }
+
+        static int lerp(int a, int b, unsigned long t, unsigned long t0, unsigned long t1) {
+            if (t1 == t0) return b;
+            return a + (int) ((long) (b - a) * (long) (t - t0) / (long) (t1 - t0));
+        }
+
+        void load(const char *path) {
+            FILE *f = fopen(path, "r");
+            if (!f) {
+                fprintf(stderr, "sim: cannot open script %s\n", path);
+                exit(1);
+            }
+            char line[256];
+            while (fgets(line, sizeof(line), f)) {
+                if (line[0] == '#' || line[0] == '\n') continue;
+                Keyframe k = Keyframe();
+                char buttons[8] = "-";
+                if (sscanf(line, "%lu %d %d %d %d %7s", &k.time, &k.ax, &k.ay, &k.az, &k.heading, buttons) < 5) continue;
+                k.a = strchr(buttons, 'A') != NULL;
+                k.b = strchr(buttons, 'B') != NULL;
+                script.push_back(k);
+            }
+            fclose(f);
+            if (script.empty()) {
+                fprintf(stderr, "sim: script %s has no keyframes\n", path);
+                exit(1);
+            }
+            duration = script.back().time;
+        }
+
+        void loadStorage(const char *path) {
+            storagePath = path;
+            FILE *f = fopen(path, "rb");
+            if (!f) return; // A store that was never written is empty
+            KeyValuePair pair;
+            while (storage.size() < MICROBIT_STORAGE_ENTRIES && fread(&pair, sizeof(pair), 1, f) == 1) {
+                storage.push_back(pair);
+            }
+            fclose(f);
+        }
+
+        void saveStorage() {
+            if (!storagePath) return;
+            FILE *f = fopen(storagePath, "wb");
+            if (!f) {
+                fprintf(stderr, "sim: cannot write storage %s\n", storagePath);
+                exit(1);
+            }
+            if (!storage.empty()) fwrite(&storage[0], sizeof(KeyValuePair), storage.size(), f);
+            fclose(f);
+        }
+
+        int findKey(const char *key) {
+            for (size_t i = 0; i < storage.size(); i++) {
+                if (strncmp((const char *) storage[i].key, key, MICROBIT_STORAGE_KEY_SIZE) == 0) return (int) i;
+            }
+            return -1;
+        }
+
+        void loadTrace(const char *path) {
+            unsigned long skipped = 0;
+            if (!readTrace(path, script, &skipped)) {
+                fprintf(stderr, "sim: %s is not a trace\n", path);
+                exit(1);
+            }
+            if (script.empty()) {
+                fprintf(stderr, "sim: trace %s has no records\n", path);
+                exit(1);
+            }
+            if (skipped) fprintf(stderr, "sim: skipped %lu corrupt bytes of trace %s\n", skipped, path);
+            // Recorded time starts at boot, so play it back from the first sample.
+            const unsigned long first = script.front().time;
+            for (size_t i = 0; i < script.size(); i++) script[i].time -= first;
+            duration = script.back().time;
+            hold = true;
+        }
+
+        static void report() {
+            Simulator &s = instance();
+            s.accountRate();
+            const unsigned long ran = s.now();
+            double seconds = ran / 1000.0;
+            if (seconds <= 0) seconds = 1e-3;
+            if (s.clock.isVirtual()) {
+                fprintf(stderr, "sim: ran %lu ms on the virtual clock in %.1f ms\n", ran, s.clock.hostMs());
+            } else {
+                fprintf(stderr, "sim: ran %lu ms\n", ran);
+            }
+            fprintf(stderr, "sim: %lu accelerometer reads (%.0f/s) of %lu distinct samples, produced at %.1f Hz on average\n",
+                    s.stats.accelerometerReads, s.stats.accelerometerReads / seconds, s.stats.accelerometerSamples,
+                    s.stats.accelerometerSampleMs / seconds);
+            fprintf(stderr, "sim: %lu compass reads (%.0f/s) of %lu distinct samples\n",
+                    s.stats.compassReads, s.stats.compassReads / seconds, s.stats.compassSamples);
+            fprintf(stderr, "sim: %lu display prints (%.0f/s), %lu changed the frame\n",
+                    s.stats.displayPrints, s.stats.displayPrints / seconds, s.stats.frameChanges);
+            fprintf(stderr, "sim: %lu wakeups (%.0f/s), %lu sensor events, CPU busy %.1f%% of the time\n",
+                    s.stats.wakeups, s.stats.wakeups / seconds, s.stats.events,
+                    100.0 * (1.0 - s.stats.sleptMs / (ran > 0 ? ran : 1)));
+            if (s.stats.i2cTransactions) {
+                fprintf(stderr, "sim: %lu I2C transactions (%.0f/s) moving %lu bytes, %.2f per accelerometer sample\n",
+                        s.stats.i2cTransactions, s.stats.i2cTransactions / seconds, s.stats.i2cBytes,
+                        (double) s.stats.i2cTransactions / (s.stats.accelerometerSamples ? s.stats.accelerometerSamples : 1));
+            }
+            if (s.stats.firstFrameMs >= 0) {
+                fprintf(stderr, "sim: first frame after %ld ms, %lu compass calibrations, %lu storage reads, %lu writes\n",
+                        s.stats.firstFrameMs, s.stats.calibrations, s.stats.storageReads, s.stats.storageWrites);
+            }
+            if (s.stats.fifoStolen) {
+                fprintf(stderr, "sim: %lu accelerometer samples read out of the FIFO by the runtime's driver\n",
+                        s.stats.fifoStolen);
+            }
+            if (s.stats.buttonEvents) fprintf(stderr, "sim: %lu button events\n", s.stats.buttonEvents);
+            if (s.stats.serialBytes) {
+                fprintf(stderr, "sim: %lu bytes sent over serial (%.0f/s), %lu sends fell short\n",
+                        s.stats.serialBytes, s.stats.serialBytes / seconds, s.stats.serialShort);
+            }
+        }
+
+        // Earliest time at which a sensor with a listener has a sample it has not announced yet.
+        bool nextEvent(unsigned long &t) {
+            bool found = false;
+            SensorTiming *sensors[] = {&accelerometer, &compass};
+            int ids[] = {MICROBIT_ID_ACCELEROMETER, MICROBIT_ID_COMPASS};
+            for (int i = 0; i < 2; i++) {
+                if (!listening(ids[i])) continue;
+                const unsigned long due = (sensors[i]->lastAnnounced + 1) * sensors[i]->period;
+                if (!found || due < t) t = due;
+                found = true;
+            }
+            const Keyframe *edge = listeningToButtons() ? nextEdge() : NULL;
+            if (edge != NULL && (!found || edge->time < t)) {
+                t = edge->time;
+                found = true;
+            }
+            if (loadPeriodMs != 0 && (!found || nextLoad < t)) {
+                t = nextLoad;
+                found = true;
+            }
+            return found;
+        }
+
+        void announce(SensorTiming &sensor, int id, int value) {
+            const unsigned long t = now();
+            if (!listening(id) || sensor.index(t) <= sensor.lastAnnounced) return;
+            sensor.lastAnnounced = sensor.index(t);
+            stats.events++;
+            clock.spend(COST_EVENT_US);
+            MicroBitEvent e(id, value);
+            e.timestamp = (uint64_t) t * 1000;
+            dispatch(e);
+        }
+
+        void dispatch(MicroBitEvent e) {
+            for (size_t i = 0; i < listeners.size(); i++) {
+                if (listeners[i].id == e.source && (listeners[i].value == MICROBIT_EVT_ANY || listeners[i].value == e.value)) {
+                    listeners[i].handler(e);
+                }
+            }
+        }
+
+        bool listeningToButtons() {
+            return listening(MICROBIT_ID_BUTTON_A) || listening(MICROBIT_ID_BUTTON_B) || listening(MICROBIT_ID_BUTTON_AB);
+        }
+
+        // The next keyframe that changes a button, or NULL if none does.
+        const Keyframe *nextEdge() {
+            while (edgeCursor < script.size() && script[edgeCursor].a == pressedA && script[edgeCursor].b == pressedB) {
+                edgeCursor++;
+            }
+            return edgeCursor < script.size() ? &script[edgeCursor] : NULL;
+        }
+
+        void raiseButton(int id, bool down, unsigned long edge) {
+            if (!listening(id)) return;
+            stats.buttonEvents++;
+            clock.spend(COST_EVENT_US);
+            MicroBitEvent e(id, down ? MICROBIT_BUTTON_EVT_DOWN : MICROBIT_BUTTON_EVT_UP);
+            e.timestamp = (uint64_t) edge * 1000;
+            dispatch(e);
+        }
+
+        // Raises a down or up event for every button edge up to now, as the runtime's debouncer would.
+        void announceButtons() {
+            const unsigned long t = now();
+            const Keyframe *k;
+            while ((k = nextEdge()) != NULL && k->time <= t) {
+                const bool wasBoth = pressedA && pressedB;
+                const unsigned long edge = k->time;
+                const bool a = k->a, b = k->b;
+                if (a != pressedA) {
+                    pressedA = a;
+                    raiseButton(MICROBIT_ID_BUTTON_A, a, edge);
+                }
+                if (b != pressedB) {
+                    pressedB = b;
+                    raiseButton(MICROBIT_ID_BUTTON_B, b, edge);
+                }
+                if ((a && b) != wasBoth) raiseButton(MICROBIT_ID_BUTTON_AB, a && b, edge);
+            }
+        }
+
+        // Runs the other fiber's busy stretch if one is due, holding up everything else on the CPU.
+        void runLoad() {
+            const unsigned long t = now();
+            if (loadPeriodMs == 0 || t < nextLoad) return;
+            nextLoad += ((t - nextLoad) / loadPeriodMs + 1) * loadPeriodMs;
+            clock.busy((uint64_t) loadMs * 1000);
+        }
+
+        void sleepUntil(unsigned long t) {
+            const uint64_t before = clock.nowUs();
+            clock.sleepUntil(t);
+            stats.sleptMs += (clock.nowUs() - before) / 1000.0;
+            stats.wakeups++;
+        }
+    public:
+        Stats stats;
+        Clock clock;
+        SerialLine serial;
+        SensorTiming accelerometer = SensorTiming(20);
+        SensorTiming compass       = SensorTiming(20);
+        unsigned long calibrationMs = 0;
+
+        static Simulator &instance() {
+            static Simulator s;
+            return s;
+        }
+
+        void init() {
+            const char *clockName = getenv("UBIT_CLOCK");
+            if (clockName && strcmp(clockName, "virtual") != 0 && strcmp(clockName, "real") != 0) {
+                fprintf(stderr, "sim: UBIT_CLOCK must be real or virtual, not %s\n", clockName);
+                exit(1);
+            }
+            clock.begin(clockName && strcmp(clockName, "virtual") == 0);
+            memset(framebuffer, 0, sizeof(framebuffer));
+            printFrames = getenv("UBIT_FRAMES") != NULL;
+            serial.sink = stdout;
+            if (getenv("UBIT_SERIAL")) {
+                serial.sink = fopen(getenv("UBIT_SERIAL"), "wb");
+                if (!serial.sink) {
+                    fprintf(stderr, "sim: cannot open %s\n", getenv("UBIT_SERIAL"));
+                    exit(1);
+                }
+            }
+            if (getenv("UBIT_STORAGE")) loadStorage(getenv("UBIT_STORAGE"));
+            if (getenv("UBIT_CALIBRATION_MS")) calibrationMs = strtoul(getenv("UBIT_CALIBRATION_MS"), NULL, 10);
+            const char *busy = getenv("UBIT_LOAD");
+            if (busy && *busy && (sscanf(busy, "%lu/%lu", &loadMs, &loadPeriodMs) != 2 || loadPeriodMs == 0
+                                  || loadMs > loadPeriodMs)) {
+                fprintf(stderr, "sim: UBIT_LOAD must be busy/period in ms, such as 8/10, not %s\n", busy);
+                exit(1);
+            }
+            const char *path = getenv("UBIT_SCRIPT");
+            if (getenv("UBIT_TRACE")) {
+                loadTrace(getenv("UBIT_TRACE"));
+            } else if (path) {
+                load(path);
+            } else {
+                if (getenv("UBIT_DURATION")) duration = strtoul(getenv("UBIT_DURATION"), NULL, 10);
+                Keyframe rest = Keyframe();
+                rest.az = -1024;
+                script.push_back(rest);
+            }
+            atexit(&Simulator::report);
+            running = true;
+        }
+
+        /*
+         * Plays keyframes on the virtual clock, for host tools that step a board themselves rather than run it
+         * from the environment. The process is not ended at the last keyframe, which holds from then on.
+         */
+        void play(std::vector<Keyframe> const& keyframes) {
+            clock.begin(true);
+            script = keyframes;
+            duration = script.back().time;
+            cursor = 0;
+            edgeCursor = 0;
+        }
+
+        unsigned long now() {
+            return (unsigned long) (clock.nowUs() / 1000);
+        }
+
+        /*
+         * Called on every runtime entry point. The firmware never returns from its main loop,
+         * so the simulation ends the process once the script has played out.
+         */
+        void poll() {
+            if (!running || finished) return;
+            if (now() >= duration) {
+                finished = true;
+                exit(0);
+            }
+        }
+
+        // The scripted sensor values at time t.
+        Keyframe at(unsigned long t) {
+            while (cursor > 0 && script[cursor].time > t) cursor--;
+            while (cursor + 1 < script.size() && script[cursor + 1].time <= t) cursor++;
+            const Keyframe &a = script[cursor];
+            if (hold || cursor + 1 == script.size()) return a;
+            const Keyframe &b = script[cursor + 1];
+            Keyframe k = a;
+            k.time    = t;
+            k.ax      = lerp(a.ax, b.ax, t, a.time, b.time);
+            k.ay      = lerp(a.ay, b.ay, t, a.time, b.time);
+            k.az      = lerp(a.az, b.az, t, a.time, b.time);
+            k.heading = lerp(a.heading, b.heading, t, a.time, b.time);
+            return k;
+        }
+
+        Keyframe sample() {
+            poll();
+            clock.spend(COST_READ_US);
+            return at(now());
+        }
+
+        // The latest sample a sensor has produced, counting the reads and how many distinct samples they saw.
+        Keyframe read(SensorTiming &sensor, unsigned long &reads, unsigned long &samples) {
+            poll();
+            const unsigned long t = now();
+            reads++;
+            // The accelerometer and magnetometer are one part, which the runtime reads from OUT_X_MSB.
+            if (fifoQueued(t) > 0) {
+                stats.fifoStolen++;
+                fifoNext++;
+            }
+            clock.spend(sensor.index(t) != sensor.lastRead ? COST_SAMPLE_US : COST_READ_US);
+            if (sensor.index(t) != sensor.lastRead) {
+                samples++;
+                stats.i2cTransactions++;
+                stats.i2cBytes += 6;
+            }
+            sensor.lastRead = sensor.index(t);
+            return at(sensor.sampleTime(t));
+        }
+
+        bool listening(int id) {
+            for (size_t i = 0; i < listeners.size(); i++) {
+                if (listeners[i].id == id) return true;
+            }
+            return false;
+        }
+
+        void listen(int id, int value, std::function<void(MicroBitEvent)> handler) {
+            Listener l = {id, value, handler};
+            listeners.push_back(l);
+        }
+
+        /*
+         * Sleeps for ms, waking to raise a data-ready event whenever a listened-to sensor
+         * produces a new sample, the way the runtime's idle loop does on the device.
+         */
+        void sleep(int ms) {
+            stats.sleeps++;
+            const unsigned long target = now() + ms;
+            while (1) {
+                unsigned long wake = target;
+                unsigned long event = 0;
+                if (nextEvent(event) && event < wake) wake = event;
+                sleepUntil(wake);
+                poll();
+                runLoad();
+                announce(accelerometer, MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE);
+                announce(compass, MICROBIT_ID_COMPASS, MICROBIT_COMPASS_EVT_DATA_UPDATE);
+                announceButtons();
+                if (now() >= target) return;
+            }
+        }
+
+        int send(const uint8_t *bytes, int length, MicroBitSerialMode mode) {
+            poll();
+            serial.drain(now());
+            int n = length;
+            if (mode == ASYNC) {
+                const int room = serial.bufferSize - (int) ceil(serial.queued);
+                if (room < n) n = room > 0 ? room : 0;
+                if (n < length) stats.serialShort++;
+                serial.queued += n;
+            }
+            clock.spend(COST_SERIAL_US);
+            fwrite(bytes, 1, n, serial.sink);
+            fflush(serial.sink);
+            stats.serialBytes += n;
+            return n;
+        }
+
+        /*
+         * A register read from the accelerometer, the only part on the bus the firmware addresses directly.
+         * Reading the output registers with the FIFO on pops a sample for every 6 bytes read.
+         */
+        int i2cRead(uint8_t address, uint8_t reg, uint8_t *data, int length) {
+            poll();
+            if (address != 0x3C || length <= 0) return MICROBIT_I2C_ERROR;
+            stats.i2cTransactions++;
+            stats.i2cBytes += length;
+            clock.spend(COST_I2C_TRANSACTION_US + (uint64_t) length * COST_I2C_BYTE_US);
+            const unsigned long t = now();
+            memset(data, 0, length);
+            if (reg == 0x00) {
+                data[0] = (uint8_t) fifoQueued(t);
+            } else if (reg == 0x01 && fifoOn()) {
+                const int n = std::min(length / 6, fifoQueued(t));
+                stats.accelerometerReads++;
+                stats.accelerometerSamples += n;
+                for (int i = 0; i < n; i++, fifoNext++) {
+                    const Keyframe k = at(fifoNext * accelerometer.period);
+                    putSample(data + 6 * i, k.ax);
+                    putSample(data + 6 * i + 2, k.ay);
+                    putSample(data + 6 * i + 4, k.az);
+                }
+            } else if (reg == 0x01 && length >= 6) {
+                const Keyframe k = at(accelerometer.sampleTime(t));
+                stats.accelerometerReads++;
+                if (accelerometer.index(t) != accelerometer.lastRead) stats.accelerometerSamples++;
+                accelerometer.lastRead = accelerometer.index(t);
+                putSample(data, k.ax);
+                putSample(data + 2, k.ay);
+                putSample(data + 4, k.az);
+            } else if (reg == 0x09) {
+                data[0] = fifoSetup;
+            } else if (reg == 0x0D) {
+                data[0] = 0xC7;
+            } else if (reg == 0x2A) {
+                data[0] = ctrlReg1;
+            } else if (reg == 0x2D) {
+                data[0] = ctrlReg4;
+            }
+            return MICROBIT_OK;
+        }
+
+        int i2cWrite(uint8_t address, uint8_t reg, uint8_t value) {
+            poll();
+            if (address != 0x3C) return MICROBIT_I2C_ERROR;
+            stats.i2cTransactions++;
+            stats.i2cBytes += 1;
+            clock.spend(COST_I2C_TRANSACTION_US + COST_I2C_BYTE_US);
+            if (reg == 0x09) {
+                // The FIFO can only be set up in standby, and starts empty.
+                if (ctrlReg1 & 0x01) return MICROBIT_OK;
+                fifoSetup = value;
+                fifoNext = accelerometer.index(now()) + 1;
+            } else if (reg == 0x2A) {
+                ctrlReg1 = value;
+            } else if (reg == 0x2D) {
+                ctrlReg4 = value;
+            }
+            return MICROBIT_OK;
+        }
+
+        /*
+         * Changes a sensor's output data rate. Sample indexes restart from the current time at the new period,
+         * and samples still in the FIFO are lost, as when the part is reconfigured.
+         */
+        void setPeriod(SensorTiming &sensor, int period) {
+            if (&sensor == &accelerometer) accountRate();
+            // The runtime sets the rate of either sensor by configuring the part afresh, with the data-ready
+            // interrupt its driver waits on in place of whatever the firmware set up. The FIFO setup is left alone.
+            ctrlReg1 |= 0x01;
+            ctrlReg4 = 0x01;
+            const unsigned long t = now();
+            sensor.period = period > 0 ? period : 1;
+            sensor.lastAnnounced = sensor.index(t);
+            sensor.lastRead = -1;
+            if (&sensor == &accelerometer) fifoNext = accelerometer.index(t) + 1;
+        }
+
+        // The user rolling the board around until the calibration has seen every direction.
+        void calibrate() {
+            poll();
+            stats.calibrations++;
+            clock.sleepUntil(now() + calibrationMs);
+        }
+
+        KeyValuePair *storageGet(const char *key) {
+            poll();
+            stats.storageReads++;
+            clock.spend(COST_STORAGE_READ_US);
+            const int i = findKey(key);
+            return i < 0 ? NULL : new KeyValuePair(storage[i]);
+        }
+
+        int storagePut(const char *key, const uint8_t *data, int size) {
+            poll();
+            if (strlen(key) >= MICROBIT_STORAGE_KEY_SIZE || size < 0 || size > MICROBIT_STORAGE_VALUE_SIZE) {
+                return MICROBIT_INVALID_PARAMETER;
+            }
+            int i = findKey(key);
+            if (i < 0) {
+                if (storage.size() >= MICROBIT_STORAGE_ENTRIES) return MICROBIT_NO_RESOURCES;
+                storage.push_back(KeyValuePair());
+                i = (int) storage.size() - 1;
+            }
+            memset(&storage[i], 0, sizeof(KeyValuePair));
+            strncpy((char *) storage[i].key, key, MICROBIT_STORAGE_KEY_SIZE);
+            memcpy(storage[i].value, data, size);
+            stats.storageWrites++;
+            clock.spend(COST_STORAGE_WRITE_US);
+            saveStorage();
+            return MICROBIT_OK;
+        }
+
+        int storageRemove(const char *key) {
+            poll();
+            const int i = findKey(key);
+            if (i < 0) return MICROBIT_NO_DATA;
+            storage.erase(storage.begin() + i);
+            stats.storageWrites++;
+            clock.spend(COST_STORAGE_WRITE_US);
+            saveStorage();
+            return MICROBIT_OK;
+        }
+
+        int storageSize() {
+            return (int) storage.size();
+        }
+
+        void present(const uint8_t *pixels) {
+            stats.displayPrints++;
+            clock.spend(COST_DISPLAY_US);
+            if (stats.firstFrameMs < 0) stats.firstFrameMs = (long) now();
+            if (memcmp(pixels, framebuffer, sizeof(framebuffer)) == 0) return;
+            memcpy(framebuffer, pixels, sizeof(framebuffer));
+            stats.frameChanges++;
+            if (!printFrames) return;
+            printf("%lu ms\n", now());
+            for (int y = 0; y < 5; y++) {
+                for (int x = 0; x < 5; x++) putchar(framebuffer[y * 5 + x] ? '#' : '.');
+                putchar('\n');
+            }
+        }
+};
+
+/*
+ * Earth's field as the magnetometer of a board sees it, when its accelerometer reads <ax, ay, az>
+ * and it faces heading degrees clockwise from magnetic north.
+ * Uses the model of Freescale AN4248: B = Rx(roll) Ry(pitch) Rz(yaw) [H, 0, V].
+ */
+#define FIELD_HORIZONTAL 20000
+#define FIELD_VERTICAL 40000
+inline void magneticField(int ax, int ay, int az, double heading, double field[3]) {
+    // The accelerometer reads -1g on z when flat, so gravity points the other way.
+    const double gx = -ax, gy = -ay, gz = -az;
+    const double roll = atan2(gy, gz);
+    const double pitch = atan2(-gx, gy * sin(roll) + gz * cos(roll));
+    const double yaw = heading * PI / 180;
+    // Rz(yaw)
+    const double x1 = cos(yaw) * FIELD_HORIZONTAL, y1 = -sin(yaw) * FIELD_HORIZONTAL, z1 = FIELD_VERTICAL;
+    // Ry(pitch)
+    const double x2 = cos(pitch) * x1 - sin(pitch) * z1, y2 = y1, z2 = sin(pitch) * x1 + cos(pitch) * z1;
+    // Rx(roll)
+    field[0] = x2;
+    field[1] = cos(roll) * y2 + sin(roll) * z2;
+    field[2] = -sin(roll) * y2 + cos(roll) * z2;
+}
+
+/*
+ * Floating point tilt-compensated bearing, the way the runtime's compass.heading() works it out.
+ * @return degrees clockwise from magnetic north, from 0 to <360
+ */
+inline int tiltCompensatedBearing(int ax, int ay, int az, const double field[3]) {
+    const double gx = -ax, gy = -ay, gz = -az;
+    const double roll = atan2(gy, gz);
+    const double pitch = atan2(-gx, gy * sin(roll) + gz * cos(roll));
+    const double y = field[2] * sin(roll) - field[1] * cos(roll);
+    const double x = field[0] * cos(pitch) + field[1] * sin(pitch) * sin(roll) + field[2] * sin(pitch) * cos(roll);
+    double bearing = atan2(y, x) * 180 / PI;
+    if (bearing < 0) bearing += 360;
+    return (int) bearing % 360;
+}
+
+/*
+ * Rows of the digit glyphs, most significant of the low five bits is the leftmost column.
+ */
+static const uint8_t DIGITS[10][5] = {
+    {0x0C, 0x12, 0x12, 0x12, 0x0C}, {0x04, 0x0C, 0x04, 0x04, 0x0E},
+    {0x1C, 0x02, 0x0C, 0x10, 0x1E}, {0x1E, 0x02, 0x04, 0x12, 0x0C},
+    {0x06, 0x0A, 0x12, 0x1F, 0x02}, {0x1F, 0x10, 0x1E, 0x01, 0x1E},
+    {0x02, 0x04, 0x0E, 0x11, 0x0E}, {0x1F, 0x02, 0x04, 0x08, 0x10},
+    {0x0E, 0x11, 0x0E, 0x11, 0x0E}, {0x0E, 0x11, 0x0E, 0x04, 0x08},
+};
+
+} // namespace sim
+
+class MicroBitImage {
+    private:
+        int width;
+        int height;
+        std::vector<uint8_t> pixels;
+    public:
+        MicroBitImage(int width = 5, int height = 5) : width(width), height(height), pixels(width * height, 0) {}
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        uint8_t *getBitmap() { return &pixels[0]; }
+        const uint8_t *getBitmap() const { return &pixels[0]; }
+
+        int setPixelValue(int16_t x, int16_t y, uint8_t value) {
+            if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+            pixels[y * width + x] = value;
+            return 0;
+        }
+
+        int getPixelValue(int16_t x, int16_t y) {
+            if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+            return pixels[y * width + x];
+        }
+
+        void clear() {
+            std::fill(pixels.begin(), pixels.end(), 0);
+        }
+
+        int print(char c, int16_t x = 0, int16_t y = 0) {
+            if (c < '0' || c > '9') return -1;
+            for (int row = 0; row < 5; row++) {
+                for (int col = 0; col < 5; col++) {
+                    if (sim::DIGITS[c - '0'][row] & (0x10 >> col)) setPixelValue(x + col, y + row, 255);
+                }
+            }
+            return 0;
+        }
+};
+
+/*
+ * Each part of the board belongs to the Simulator of the MicroBit it is part of,
+ * so that any number of boards can run side by side.
+ */
+class MicroBitDisplay {
+    private:
+        sim::Simulator *sim;
+    public:
+        explicit MicroBitDisplay(sim::Simulator *sim) : sim(sim) {}
+
+        int print(MicroBitImage i, int16_t x = 0, int16_t y = 0, int alpha = 0, int delay = 0) {
+            (void) x; (void) y; (void) alpha; (void) delay;
+            sim->present(i.getBitmap());
+            return 0;
+        }
+
+        int print(char c, int delay = 0) {
+            (void) delay;
+            MicroBitImage i(5, 5);
+            i.print(c);
+            return print(i);
+        }
+
+        int print(int n, int delay = 0) {
+            if (n >= 0 && n <= 9) return print((char) ('0' + n), delay);
+            return print('0', delay);
+        }
+};
+
+class MicroBitButton {
+    private:
+        sim::Simulator *sim;
+        bool useA;
+        bool useB;
+    public:
+        MicroBitButton(sim::Simulator *sim, bool useA, bool useB) : sim(sim), useA(useA), useB(useB) {}
+
+        int isPressed() {
+            sim->stats.buttonReads++;
+            sim::Keyframe k = sim->sample();
+            return (!useA || k.a) && (!useB || k.b);
+        }
+};
+
+typedef MicroBitButton MicroBitMultiButton;
+
+class MicroBitAccelerometer {
+    private:
+        sim::Simulator *sim;
+    public:
+        explicit MicroBitAccelerometer(sim::Simulator *sim) : sim(sim) {}
+
+        int getX() { return read().ax; }
+        int getY() { return read().ay; }
+        int getZ() { return read().az; }
+
+        int setPeriod(int period) {
+            sim->setPeriod(sim->accelerometer, period);
+            return 0;
+        }
+
+        int getPeriod() {
+            return (int) sim->accelerometer.period;
+        }
+    private:
+        sim::Keyframe read() {
+            return sim->read(sim->accelerometer, sim->stats.accelerometerReads, sim->stats.accelerometerSamples);
+        }
+};
+
+class MicroBitCompass {
+    private:
+        sim::Simulator *sim;
+        bool calibrated = false;
+        CompassCalibration calibration;
+
+        static void field(sim::Keyframe const& k, double field[3]) {
+            if (k.raw) {
+                field[0] = k.mx;
+                field[1] = k.my;
+                field[2] = k.mz;
+            } else {
+                sim::magneticField(k.ax, k.ay, k.az, k.heading, field);
+            }
+        }
+
+        void field(double field[3]) {
+            this->field(sim->read(sim->compass, sim->stats.compassReads, sim->stats.compassSamples), field);
+        }
+    public:
+        explicit MicroBitCompass(sim::Simulator *sim) : sim(sim) {}
+
+        int heading() {
+            sim::Keyframe k = sim->read(sim->compass, sim->stats.compassReads, sim->stats.compassSamples);
+            double f[3];
+            field(k, f);
+            return sim::tiltCompensatedBearing(k.ax, k.ay, k.az, f);
+        }
+
+        int getX() { double f[3]; field(f); return (int) lround(f[0]); }
+        int getY() { double f[3]; field(f); return (int) lround(f[1]); }
+        int getZ() { double f[3]; field(f); return (int) lround(f[2]); }
+
+        int setPeriod(int period) {
+            sim->setPeriod(sim->compass, period);
+            return 0;
+        }
+
+        int getPeriod() {
+            return (int) sim->compass.period;
+        }
+
+        int isCalibrated() { return calibrated; }
+        int isCalibrating() { return 0; }
+
+        // The field is modelled without hard or soft iron, so the calibration comes out as the identity.
+        int calibrate() {
+            sim->calibrate();
+            calibration = CompassCalibration();
+            calibration.radius = (int) hypot(FIELD_HORIZONTAL, FIELD_VERTICAL);
+            calibrated = true;
+            return MICROBIT_OK;
+        }
+
+        CompassCalibration getCalibration() {
+            return calibration;
+        }
+
+        void setCalibration(CompassCalibration calibration) {
+            this->calibration = calibration;
+            calibrated = true;
+        }
+};
+
+class MicroBitI2C {
+    private:
+        sim::Simulator *sim;
+    public:
+        explicit MicroBitI2C(sim::Simulator *sim) : sim(sim) {}
+
+        int readRegister(uint8_t address, uint8_t reg, uint8_t *data, int length) {
+            return sim->i2cRead(address, reg, data, length);
+        }
+
+        int writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+            return sim->i2cWrite(address, reg, value);
+        }
+};
+
+class MicroBitStorage {
+    private:
+        sim::Simulator *sim;
+    public:
+        explicit MicroBitStorage(sim::Simulator *sim) : sim(sim) {}
+
+        // @return a copy of the pair, which the caller deletes, or NULL if there is no such key
+        KeyValuePair *get(const char *key) {
+            return sim->storageGet(key);
+        }
+
+        int put(const char *key, uint8_t *data, int dataSize) {
+            return sim->storagePut(key, data, dataSize);
+        }
+
+        int remove(const char *key) {
+            return sim->storageRemove(key);
+        }
+
+        int size() {
+            return sim->storageSize();
+        }
+};
+
+class MicroBitSerial {
+    private:
+        sim::Simulator *sim;
+    public:
+        explicit MicroBitSerial(sim::Simulator *sim) : sim(sim) {}
+
+        int send(uint8_t *buffer, int length, MicroBitSerialMode mode = ASYNC) {
+            return sim->send(buffer, length, mode);
+        }
+
+        int baud(int rate) {
+            sim->serial.baud = rate;
+            return 0;
+        }
+
+        int setTxBufferSize(uint8_t size) {
+            sim->serial.bufferSize = size;
+            return 0;
+        }
+
+        int printf(const char *format, ...) {
+            va_list args;
+            va_start(args, format);
+            const int n = vprintf(format, args);
+            va_end(args);
+            return n;
+        }
+};
+
+class MicroBitMessageBus {
+    private:
+        sim::Simulator *sim;
+    public:
+        explicit MicroBitMessageBus(sim::Simulator *sim) : sim(sim) {}
+
+        int listen(int id, int value, void (*handler)(MicroBitEvent), uint16_t flags = 0) {
+            (void) flags;
+            sim->listen(id, value, handler);
+            return 0;
+        }
+
+        template <typename T>
+        int listen(int id, int value, T *object, void (T::*handler)(MicroBitEvent), uint16_t flags = 0) {
+            (void) flags;
+            sim->listen(id, value, [object, handler](MicroBitEvent e) { (object->*handler)(e); });
+            return 0;
+        }
+};
+
+/*
+ * A board. The firmware's uBit plays the process-wide Simulator, which init() loads from the environment.
+ * Host tools can construct more boards, each on a Simulator of its own.
+ */
+class MicroBit {
+    private:
+        sim::Simulator *sim;
+    public:
+        MicroBitI2C i2c;
+        MicroBitAccelerometer accelerometer;
+        MicroBitCompass compass;
+        MicroBitDisplay display;
+        MicroBitMessageBus messageBus;
+        MicroBitSerial serial;
+        MicroBitStorage storage;
+        MicroBitButton buttonA;
+        MicroBitButton buttonB;
+        MicroBitMultiButton buttonAB;
+
+        explicit MicroBit(sim::Simulator &simulator = sim::Simulator::instance())
+            : sim(&simulator), i2c(sim), accelerometer(sim), compass(sim), display(sim), messageBus(sim), serial(sim), storage(sim),
+              buttonA(sim, true, false), buttonB(sim, false, true), buttonAB(sim, true, true) {}
+
+        sim::Simulator &simulator() {
+            return *sim;
+        }
+
+        void init() {
+            sim->init();
+        }
+
+        unsigned long systemTime() {
+            sim->poll();
+            sim->clock.spend(COST_TIME_US);
+            return sim->now();
+        }
+
+        void sleep(int ms) {
+            sim->sleep(ms);
+        }
+};
+
+inline uint64_t system_timer_current_time_us() {
+    sim::Simulator &s = sim::Simulator::instance();
+    s.clock.spend(COST_TIME_US);
+    return s.clock.nowUs();
+}
+
+inline void release_fiber() {
+    exit(0);
+}
+
+/*
+ * There is only one thread of execution on the host, so a new fiber simply runs to completion.
+ * The firmware's fibers never return; the simulation ends when the script does.
+ */
+inline void create_fiber(void (*entry)(), void (*completion)() = release_fiber) {
+    entry();
+    completion();
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Accuracy and cost of Angle against the floating point Math path it replaces.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/atan2_report.cpp -o atan2-report && ./atan2-report
+ */
+#include <math.h>
+#include <stdio.h>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "bench.h"
+
+#define SAMPLES 4096
+#define SECTORS 18 // 20 degree sectors, as the ring was once split into
+
+static double wrapDegrees(double d) {
+    while (d > 180) d -= 360;
+    while (d <= -180) d += 360;
+    return d;
+}
+
+int main() {
+    // Accelerometer-sized vectors all the way round the circle, plus the axes and diagonals.
+    static int xs[SAMPLES], ys[SAMPLES];
+    for (int i = 0; i < SAMPLES; i++) {
+        const double a = 2 * M_PI * i / SAMPLES;
+        const double r = 64 + (i * 7919) % 1984;
+        xs[i] = (int) lround(r * cos(a));
+        ys[i] = (int) lround(r * sin(a));
+    }
+
+    double maxVsExact = 0, sumVsExact = 0, maxVsMath = 0;
+    int sectorMismatches = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        const double exact = atan2((double) ys[i], (double) xs[i]) * 180 / M_PI;
+        const double fixed = Angle::of(xs[i], ys[i]) * 360.0 / 65536;
+        const double reference = Math::degrees(xs[i], ys[i]);
+        const double e = fabs(wrapDegrees(fixed - exact));
+        maxVsExact = e > maxVsExact ? e : maxVsExact;
+        sumVsExact += e;
+        const double m = fabs(wrapDegrees(fixed - reference));
+        maxVsMath = m > maxVsMath ? m : maxVsMath;
+        if (Angle::sector(xs[i], ys[i], SECTORS) != (int) reference / 20) sectorMismatches++;
+    }
+
+    printf("accuracy over %d vectors\n", SAMPLES);
+    printf("  Angle::of vs atan2:        max %.4f deg, mean %.4f deg\n", maxVsExact, sumVsExact / SAMPLES);
+    printf("  Angle::of vs Math::degrees max %.4f deg\n", maxVsMath);
+    printf("  sector mismatches:         %d of %d (sector edges only)\n", sectorMismatches, SAMPLES);
+
+    const long iterations = 20000000;
+    bench::Timing fixed = bench::measure(iterations, [](long i) {
+        return (long) Angle::sector(xs[i & (SAMPLES - 1)], ys[i & (SAMPLES - 1)], SECTORS);
+    });
+    bench::Timing reference = bench::measure(iterations, [](long i) {
+        return (long) Math::degrees(xs[i & (SAMPLES - 1)], ys[i & (SAMPLES - 1)]) / 20;
+    });
+    printf("cost per 20 degree sector\n");
+    printf("  Angle::sector:      %6.1f ns, %6.1f cycles\n", fixed.nsPerCall, fixed.cyclesPerCall);
+    printf("  Math::degrees / 20: %6.1f ns, %6.1f cycles\n", reference.nsPerCall, reference.cyclesPerCall);
+    return 0;
+}
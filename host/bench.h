@@ -0,0 +1,54 @@
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+/*
+ * Timing helpers shared by the host-side reports.
+ *
+ * Host numbers only rank implementations against each other. The Cortex-M0 has no FPU and
+ * no hardware divide, so floating point paths are much slower there than they are here.
+ */
+
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace bench {
+
+// Results are written here so that the compiler cannot drop the work being timed.
+static volatile long sink;
+
+inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct Timing {
+    double nsPerCall;
+    double cyclesPerCall;
+};
+
+/*
+ * Calls f(i) for i in [0, iterations) and reports the mean cost of one call.
+ */
+template <class F>
+Timing measure(long iterations, F f) {
+    const uint64_t c0 = cycles();
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) sink = f(i);
+    const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    const uint64_t c1 = cycles();
+    Timing t;
+    t.nsPerCall = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+    t.cyclesPerCall = (double) (c1 - c0) / iterations;
+    return t;
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,368 @@
+/*
+ * Micro-benchmarks of the maths, Circular, Buffer and ring primitives, and of a whole tick of each
+ * Question 2 class, compared against a stored baseline.
+ *
+ * Primitives run on random inputs from a fixed seed. Ticks run on a synthetic session from
+ * host/scenario.h, and again on each recorded trace given. Each benchmark is timed REPEATS times and
+ * the fastest run kept, which is the least disturbed by the rest of the host.
+ *
+ * A shared host can run the whole suite at half speed, so every run is paired with a run of a fixed
+ * reference loop just before it, and each benchmark is also given as its cost in reference loops.
+ * That relative cost is what is compared against the baseline, so a baseline carries over between
+ * runs on a loaded host, though not between hosts with different CPUs.
+ *
+ * Results go to stdout one per line, as the benchmark name, ns per call, cycles per call and relative
+ * cost, so that they can be saved and diffed. With -b, each is also compared with the same name in a
+ * saved baseline. Anything more than the threshold percent slower is measured again, up to ATTEMPTS
+ * times keeping the best, and the suite exits with 1 if it is still slower.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/bench_suite.cpp -o bench-suite
+ *   ./bench-suite [-b baseline] [-r percent] [trace...] > bench_output.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "bench.h"
+#include "scenario.h"
+
+#define REPEATS 15
+#define ATTEMPTS 3               // Times the suite is run while any benchmark looks slower than its baseline
+#define INPUTS 4096              // Random inputs per primitive, a power of 2 so they can be indexed with a mask
+#define PRIMITIVE_CALLS 1000000L
+#define TICK_CALLS 100000L
+#define REFERENCE_CALLS 100000L
+#define REGRESSION_PERCENT 25    // Default slowdown against the baseline that fails the suite
+
+struct Result {
+    std::string name;
+    bench::Timing timing;
+    double relative; // ns per call over ns per reference loop
+};
+
+static std::vector<Result> results;
+static size_t slot = 0; // The next result to fill in on this attempt
+
+// The reference loop: a dependent chain of integer work that no change to the firmware can touch.
+static long reference(long i) {
+    uint32_t x = (uint32_t) i | 1;
+    for (int k = 0; k < 16; k++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    return (long) x;
+}
+
+template <class F>
+static void run(std::string const& name, long calls, F f) {
+    Result result = {name, bench::Timing(), 0};
+    double relative[REPEATS];
+    for (int r = 0; r < REPEATS; r++) {
+        const bench::Timing before = bench::measure(REFERENCE_CALLS, reference);
+        const bench::Timing t = bench::measure(calls, f);
+        const bench::Timing after = bench::measure(REFERENCE_CALLS, reference);
+        if (r == 0 || t.nsPerCall < result.timing.nsPerCall) result.timing = t;
+        relative[r] = 2 * t.nsPerCall / (before.nsPerCall + after.nsPerCall);
+    }
+    std::sort(relative, relative + REPEATS);
+    result.relative = relative[REPEATS / 2];
+    // Later attempts keep the best of each figure.
+    if (slot == results.size()) {
+        results.push_back(result);
+    } else {
+        Result &kept = results[slot];
+        if (result.timing.nsPerCall < kept.timing.nsPerCall) kept.timing = result.timing;
+        if (result.relative < kept.relative) kept.relative = result.relative;
+    }
+    slot++;
+}
+
+/*
+ * A trace's frames, replayed end to end as many times as a benchmark needs.
+ * Each lap is shifted on by the length of the trace, so time keeps moving forwards.
+ */
+class Frames {
+    private:
+        std::vector<SensorFrame> frames;
+        unsigned long lap;
+    public:
+        explicit Frames(std::vector<sim::Keyframe> const& trace) {
+            for (size_t i = 0; i < trace.size(); i++) {
+                const sim::Keyframe &k = trace[i];
+                SensorFrame frame = {k.time, k.ax, k.ay, k.az, k.mx, k.my, k.mz};
+                frames.push_back(frame);
+            }
+            lap = frames.back().time - frames.front().time + SAMPLE_MS;
+        }
+
+        SensorFrame at(long i) const {
+            SensorFrame frame = frames[(size_t) i % frames.size()];
+            frame.time += lap * (unsigned long) (i / (long) frames.size());
+            return frame;
+        }
+};
+
+// Payloads for Buffer: a value that changes every 32 samples or so, with a one sample glitch every 8 or so.
+struct Steps {
+    int ints[INPUTS];
+    Coord coords[INPUTS];
+    Orientation orientations[INPUTS];
+
+    explicit Steps(Random &random) {
+        int value = 0;
+        for (int i = 0; i < INPUTS; i++) {
+            if (random.chance(1.0 / 32)) value = random.between(-8, 8);
+            const int glitch = random.chance(1.0 / 8) ? random.between(1, 3) : 0;
+            ints[i] = value + glitch;
+            coords[i].x = (value + glitch) % 3;
+            coords[i].y = value / 3;
+            orientations[i] = ((value + glitch) & 1) ? VERTICAL : HORIZONTAL;
+        }
+    }
+
+    int getInt(SensorFrame const& frame) {
+        return ints[frame.time & (INPUTS - 1)];
+    }
+
+    Coord getCoord(SensorFrame const& frame) {
+        return coords[frame.time & (INPUTS - 1)];
+    }
+
+    Orientation getOrientation(SensorFrame const& frame) {
+        return orientations[frame.time & (INPUTS - 1)];
+    }
+};
+
+static SensorFrame frameAt(long i) {
+    SensorFrame frame = SensorFrame();
+    frame.time = (unsigned long) i;
+    return frame;
+}
+
+static void primitives() {
+    Random random(1);
+    static int xs[INPUTS], ys[INPUTS], zs[INPUTS], as[INPUTS], bs[INPUTS], cs[INPUTS];
+    static double ratios[INPUTS];
+    for (int i = 0; i < INPUTS; i++) {
+        xs[i] = random.between(-1024, 1024);
+        ys[i] = random.between(-1024, 1024);
+        zs[i] = random.between(-1024, 1024);
+        as[i] = random.between(0, PERIMETER_LEN - 1);
+        bs[i] = random.between(0, PERIMETER_LEN - 1);
+        cs[i] = random.between(0, PERIMETER_LEN - 1);
+        ratios[i] = random.uniform(-8, 8);
+    }
+    const int mask = INPUTS - 1;
+
+    run("math/arctan", PRIMITIVE_CALLS, [&](long i) {
+        return (long) (Math::arctan(ratios[i & mask]) * 1000);
+    });
+    run("math/radians", PRIMITIVE_CALLS, [&](long i) {
+        return (long) (Math::radians(xs[i & mask], ys[i & mask]) * 1000);
+    });
+    run("math/degrees", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Math::degrees(xs[i & mask], ys[i & mask]);
+    });
+    run("math/mod", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Math::mod(xs[i & mask], PERIMETER_LEN);
+    });
+    run("math/squaredMagnitude2", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Math::squaredMagnitude(xs[i & mask], ys[i & mask]);
+    });
+    run("math/squaredMagnitude3", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Math::squaredMagnitude(xs[i & mask], ys[i & mask], zs[i & mask]);
+    });
+    run("math/isqrt", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Math::isqrt((uint32_t) Math::squaredMagnitude(xs[i & mask], ys[i & mask], zs[i & mask]));
+    });
+    run("angle/of", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Angle::of(xs[i & mask], ys[i & mask]);
+    });
+    run("circular/compare", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Circular::compare(as[i & mask], bs[i & mask], PERIMETER_LEN);
+    });
+    run("circular/flow", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Circular::flow(as[i & mask], bs[i & mask], cs[i & mask], PERIMETER_LEN);
+    });
+    run("ring/arc", PRIMITIVE_CALLS, [&](long i) {
+        return (long) Ring<>::arc(as[i & mask], bs[i & mask]);
+    });
+
+    std::unique_ptr<Steps> steps(new Steps(random));
+    Buffer<Steps, int, &Steps::getInt> ints(15, steps.get());
+    Buffer<Steps, Coord, &Steps::getCoord> coords(15, steps.get());
+    Buffer<Steps, Orientation, &Steps::getOrientation> orientations(15, steps.get());
+    long changes = 0;
+    run("buffer/int", PRIMITIVE_CALLS, [&](long i) {
+        return (long) ints.value(frameAt(i), [&]() { changes++; });
+    });
+    run("buffer/Coord", PRIMITIVE_CALLS, [&](long i) {
+        const Coord c = coords.value(frameAt(i), [&]() { changes++; });
+        return (long) (c.x * 8 + c.y);
+    });
+    run("buffer/Orientation", PRIMITIVE_CALLS, [&](long i) {
+        return (long) orientations.value(frameAt(i), [&]() { changes++; });
+    });
+    bench::sink = changes;
+}
+
+struct Board {
+    sim::Simulator simulator;
+    MicroBit uBit;
+    Renderer renderer;
+
+    Board() : uBit(simulator), renderer(uBit) {}
+};
+
+// A tick, and a render after every tick, of each Question 2 class on the frames of one trace.
+static void ticks(const char *input, Frames const& frames) {
+    const std::string suffix = std::string(":") + input;
+    {
+        std::unique_ptr<Board> board(new Board());
+        VerticalParadox<> vertical(board->renderer);
+        run("tick/VerticalParadox" + suffix, TICK_CALLS, [&](long i) {
+            vertical.tick(frames.at(i));
+            return (long) vertical.getStep();
+        });
+        run("render/VerticalParadox" + suffix, TICK_CALLS, [&](long i) {
+            vertical.tick(frames.at(i));
+            vertical.render();
+            return (long) vertical.getStep();
+        });
+    }
+    {
+        std::unique_ptr<Board> board(new Board());
+        HorizontalParadox<> horizontal(board->renderer, frames.at(0).time);
+        run("tick/HorizontalParadox" + suffix, TICK_CALLS, [&](long i) {
+            horizontal.tick(frames.at(i));
+            return (long) horizontal.getTurns();
+        });
+        run("render/HorizontalParadox" + suffix, TICK_CALLS, [&](long i) {
+            horizontal.tick(frames.at(i));
+            horizontal.render();
+            return (long) horizontal.getTurns();
+        });
+    }
+    {
+        Orienter<> orienter;
+        run("tick/Orienter" + suffix, TICK_CALLS, [&](long i) {
+            return (long) orienter.tick(frames.at(i));
+        });
+    }
+    {
+        std::unique_ptr<Board> board(new Board());
+        std::unique_ptr<ParadoxThatDrivesUsAll<> > paradox(new ParadoxThatDrivesUsAll<>(board->uBit));
+        run("tick/ParadoxThatDrivesUsAll" + suffix, TICK_CALLS, [&](long i) {
+            paradox->replay(frames.at(i));
+            return (long) paradox->getTurns();
+        });
+    }
+}
+
+static std::map<std::string, double> readBaseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot read baseline %s\n", path);
+        exit(2);
+    }
+    std::map<std::string, double> baseline;
+    char line[256], name[128];
+    double ns, cycles, relative;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%127s %lf %lf %lf", name, &ns, &cycles, &relative) == 4) baseline[name] = relative;
+    }
+    fclose(f);
+    return baseline;
+}
+
+/*
+ * Compares results with a baseline, skipping names that only one of them has.
+ * @param report whether to list every comparison on stderr
+ * @return the number of benchmarks more than percent slower than their baseline
+ */
+static int compare(std::map<std::string, double> const& baseline, double percent, bool report) {
+    int regressions = 0;
+    if (report) fprintf(stderr, "%-44s %10s %10s %8s\n", "against baseline", "before", "after", "change");
+    for (size_t i = 0; i < results.size(); i++) {
+        std::map<std::string, double>::const_iterator b = baseline.find(results[i].name);
+        if (b == baseline.end()) continue;
+        const double change = 100.0 * (results[i].relative - b->second) / b->second;
+        const bool regressed = change > percent;
+        if (regressed) regressions++;
+        if (!report) continue;
+        fprintf(stderr, "%-44s %10.4f %10.4f %+7.1f%%%s\n", results[i].name.c_str(), b->second,
+                results[i].relative, change, regressed ? "  slower" : "");
+    }
+    return regressions;
+}
+
+static void suite(std::vector<Scenario> const& synthetic, std::vector<std::vector<sim::Keyframe> > const& traces,
+                  char **paths) {
+    slot = 0;
+    primitives();
+    ticks("synthetic", Frames(synthetic[0].trace));
+    for (size_t t = 0; t < traces.size(); t++) {
+        const char *slash = strrchr(paths[t], '/');
+        ticks(slash != NULL ? slash + 1 : paths[t], Frames(traces[t]));
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *baselinePath = NULL;
+    double percent = REGRESSION_PERCENT;
+    int first = 1;
+    while (first + 1 < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-b") == 0) baselinePath = argv[first + 1];
+        else if (strcmp(argv[first], "-r") == 0) percent = atof(argv[first + 1]);
+        first += 2;
+    }
+    if (percent <= 0) {
+        fprintf(stderr, "usage: %s [-b baseline] [-r percent] [trace...]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<std::vector<sim::Keyframe> > traces;
+    for (int t = first; t < argc; t++) {
+        traces.push_back(std::vector<sim::Keyframe>());
+        if (!sim::readTrace(argv[t], traces.back()) || traces.back().empty()) {
+            fprintf(stderr, "%s is not a trace\n", argv[t]);
+            return 1;
+        }
+    }
+    std::map<std::string, double> baseline;
+    if (baselinePath != NULL) baseline = readBaseline(baselinePath);
+
+    std::vector<Scenario> synthetic(1);
+    Random random(1);
+    ScenarioBuilder(random, synthetic[0]).build(12);
+
+    // A slowdown that is really there survives another attempt. One from the rest of the host rarely does.
+    suite(synthetic, traces, argv + first);
+    for (int attempt = 1; attempt < ATTEMPTS && baselinePath != NULL; attempt++) {
+        const int slower = compare(baseline, percent, false);
+        if (slower == 0) break;
+        fprintf(stderr, "%d benchmarks look slower, measuring again\n", slower);
+        suite(synthetic, traces, argv + first);
+    }
+
+    printf("# %-42s %10s %10s %10s\n", "benchmark", "ns/call", "cyc/call", "relative");
+    for (size_t i = 0; i < results.size(); i++) {
+        printf("%-44s %10.2f %10.1f %10.4f\n", results[i].name.c_str(), results[i].timing.nsPerCall,
+               results[i].timing.cyclesPerCall, results[i].relative);
+    }
+    if (baselinePath == NULL) return 0;
+    const int regressions = compare(baseline, percent, true);
+    fprintf(stderr, "%d of %zu benchmarks more than %.0f%% slower than %s\n", regressions, baseline.size(), percent,
+            baselinePath);
+    return regressions > 0 ? 1 : 0;
+}
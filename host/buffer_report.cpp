@@ -0,0 +1,182 @@
+/*
+ * Per-sample cost of Buffer and Optional, against the versions that called getRaw and onChange
+ * through stored function pointers and copied their Optional by hand.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/buffer_report.cpp -o buffer-report && ./buffer-report
+ */
+#include <stdio.h>
+#include <type_traits>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "bench.h"
+
+#define ITERATIONS 20000000L
+#define WINDOW 15 // in samples, since the frame time is the sample index
+
+/*
+ * The Optional this replaces, kept for comparison.
+ */
+template <typename T>
+struct LegacyOptional {
+    private:
+        T _value;
+        bool _isNull;
+    public:
+        // The value is initialised, as in Optional, so that reading a null one is not undefined.
+        LegacyOptional() : _value() {
+            _isNull = true;
+        }
+
+        LegacyOptional(T value) {
+            _value = value;
+            _isNull = false;
+        }
+
+        bool isNull() {
+            return _isNull;
+        }
+
+        T _() {
+            return _value;
+        }
+
+        LegacyOptional<T> operator=(T value) {
+            _value = value;
+            _isNull = false;
+            return value;
+        }
+
+        LegacyOptional<T> operator=(LegacyOptional<T> other) {
+            _value = other._value;
+            _isNull = other._isNull;
+            return other;
+        }
+};
+
+/*
+ * The Buffer this replaces, with getRaw and onChange behind pointers, kept for comparison.
+ */
+template <class S, typename T>
+class LegacyBuffer {
+    private:
+        bool changing = false;
+        unsigned long changedSince = 0;
+        unsigned long windowMs;
+        LegacyOptional<T> currentValue = LegacyOptional<T>();
+        S *s;
+        T (S::*getRaw)(SensorFrame const&);
+    public:
+        LegacyBuffer(unsigned long windowMs, T (S::*getRaw)(SensorFrame const&), S *s) {
+            this->windowMs = windowMs;
+            this->s = s;
+            this->getRaw = getRaw;
+        }
+
+        T value(SensorFrame const& frame, void (*onChange)()) {
+            T raw = (*s.*getRaw)(frame);
+            if (currentValue.isNull()) {
+                currentValue = raw;
+                return raw;
+            }
+            if (raw == currentValue._()) {
+                changing = false;
+                return currentValue._();
+            }
+            if (!changing) {
+                changing = true;
+                changedSince = frame.time;
+            }
+            if (frame.time - changedSince >= windowMs) {
+                changing = false;
+                currentValue = raw;
+                (*onChange)();
+            }
+            return currentValue._();
+        }
+};
+
+static_assert(std::is_trivially_copyable<Optional<Coord> >::value, "Optional must stay trivially copyable");
+static_assert(!std::is_trivially_copyable<LegacyOptional<Coord> >::value, "the legacy Optional copies by hand");
+
+static long changes = 0;
+
+static void countChange() {
+    changes++;
+}
+
+// Raw values step every 64 samples and jitter in between, so both the steady and changing paths run.
+struct IntSource {
+    int getRaw(SensorFrame const& frame) {
+        return (int) ((frame.time >> 6) & 3) + ((frame.time & 7) == 0);
+    }
+};
+
+struct CoordSource {
+    Coord getRaw(SensorFrame const& frame) {
+        Coord c = {(int) ((frame.time >> 6) & 3), (int) ((frame.time >> 8) & 1) - ((frame.time & 7) == 0)};
+        return c;
+    }
+};
+
+static SensorFrame frameAt(long i) {
+    SensorFrame frame = SensorFrame();
+    frame.time = (unsigned long) i;
+    return frame;
+}
+
+static void row(const char *name, bench::Timing before, bench::Timing after) {
+    printf("%-8s %10.2f %10.2f %10.1f %10.1f %8.2fx\n", name, before.nsPerCall, after.nsPerCall,
+           before.cyclesPerCall, after.cyclesPerCall, before.nsPerCall / after.nsPerCall);
+}
+
+static int sum(Coord c) {
+    return c.x * 8 + c.y;
+}
+
+int main() {
+    IntSource intSource;
+    CoordSource coordSource;
+
+    LegacyBuffer<IntSource, int> legacyInt(WINDOW, &IntSource::getRaw, &intSource);
+    Buffer<IntSource, int, &IntSource::getRaw> currentInt(WINDOW, &intSource);
+    LegacyBuffer<CoordSource, Coord> legacyCoord(WINDOW, &CoordSource::getRaw, &coordSource);
+    Buffer<CoordSource, Coord, &CoordSource::getRaw> currentCoord(WINDOW, &coordSource);
+
+    const bench::Timing beforeInt = bench::measure(ITERATIONS, [&](long i) {
+        return (long) legacyInt.value(frameAt(i), &countChange);
+    });
+    const long legacyIntChanges = changes;
+    changes = 0;
+    const bench::Timing afterInt = bench::measure(ITERATIONS, [&](long i) {
+        return (long) currentInt.value(frameAt(i), [](){ changes++; });
+    });
+    const long currentIntChanges = changes;
+    changes = 0;
+
+    const bench::Timing beforeCoord = bench::measure(ITERATIONS, [&](long i) {
+        return (long) sum(legacyCoord.value(frameAt(i), &countChange));
+    });
+    const long legacyCoordChanges = changes;
+    changes = 0;
+    const bench::Timing afterCoord = bench::measure(ITERATIONS, [&](long i) {
+        return (long) sum(currentCoord.value(frameAt(i), [](){ changes++; }));
+    });
+    const long currentCoordChanges = changes;
+
+    printf("%ld samples each, %d sample window\n\n", ITERATIONS, WINDOW);
+    printf("%-8s %10s %10s %10s %10s %9s\n", "value", "ns before", "ns after", "cyc before", "cyc after", "speedup");
+    row("int", beforeInt, afterInt);
+    row("Coord", beforeCoord, afterCoord);
+    printf("\nsizeof Buffer<int>: %zu before, %zu after\n", sizeof(legacyInt), sizeof(currentInt));
+    printf("sizeof Buffer<Coord>: %zu before, %zu after\n", sizeof(legacyCoord), sizeof(currentCoord));
+
+    if (legacyIntChanges != currentIntChanges || legacyCoordChanges != currentCoordChanges) {
+        printf("\nchange counts differ: int %ld against %ld, Coord %ld against %ld\n", legacyIntChanges,
+               currentIntChanges, legacyCoordChanges, currentCoordChanges);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Settling latency and false triggers of the Buffer family on noisy step traces,
+ * at several loop rates, against the original tick-counting buffer.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/filter_report.cpp -o filter-report && ./filter-report
+ */
+#include <stdio.h>
+#include <random>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#define TRACE_MS 3000
+#define STEP_MS 1000
+#define BEFORE 3
+#define AFTER 7
+#define SEEDS 50
+
+struct Source {
+    int raw;
+
+    int getRaw(SensorFrame const& frame) {
+        (void) frame;
+        return raw;
+    }
+};
+
+/*
+ * The tick-counting Buffer this family replaces, kept for comparison.
+ */
+class TickBuffer {
+    private:
+        int changedCount = 0;
+        int bufferSize;
+        Optional<int> currentValue = Optional<int>();
+        Source *s;
+    public:
+        TickBuffer(int bufferSize, Source *s) : bufferSize(bufferSize), s(s) {}
+
+        int value(SensorFrame const& frame) {
+            int raw = s->getRaw(frame);
+            if (currentValue.isNull()) {
+                currentValue = raw;
+                return raw;
+            }
+            if (raw != currentValue._()) {
+                changedCount++;
+            } else {
+                changedCount = 0;
+                return currentValue._();
+            }
+            if (changedCount > bufferSize) currentValue = raw;
+            return currentValue._();
+        }
+};
+
+struct Result {
+    double latency = 0;
+    int settled = 0;
+    int falseTriggers = 0;
+};
+
+/*
+ * Runs one trace through a filter. The noise is generated per millisecond, so every loop rate
+ * sees the same disturbances: short bursts of a neighbouring value, plus single-tick spikes.
+ */
+template <class F>
+void run(F &filter, Source &source, int ticksPerMs, unsigned seed, Result &result) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> chance(0, 1);
+    SensorFrame frame = SensorFrame();
+    int previous = -1;
+    long lastCommit = -1;
+    int burstValue = 0;
+    unsigned long burstEnd = 0;
+    for (unsigned long t = 0; t < TRACE_MS; t++) {
+        const int truth = t < STEP_MS ? BEFORE : AFTER;
+        if (t >= burstEnd && chance(rng) < 0.01) {
+            burstEnd = t + 1 + rng() % 30;
+            burstValue = truth + (rng() % 2 ? 1 : -1);
+        }
+        for (int i = 0; i < ticksPerMs; i++) {
+            frame.time = t;
+            source.raw = t < burstEnd ? burstValue : truth;
+            if (chance(rng) < 0.05) source.raw = truth + (int) (rng() % 7) - 3;
+            const int value = filter.value(frame);
+            if (value != previous) {
+                if (previous != -1 && value != truth) result.falseTriggers++;
+                if (value == AFTER) lastCommit = t;
+                previous = value;
+            }
+        }
+    }
+    if (previous == AFTER && lastCommit >= STEP_MS) {
+        result.settled++;
+        result.latency += lastCommit - STEP_MS;
+    }
+}
+
+template <class F>
+void report(const char *name, F make) {
+    const int rates[] = {1, 10, 100};
+    printf("%-22s", name);
+    for (int r = 0; r < 3; r++) {
+        Result result;
+        for (unsigned seed = 0; seed < SEEDS; seed++) {
+            Source source;
+            auto filter = make(&source);
+            run(filter, source, rates[r], seed, result);
+        }
+        if (result.settled) {
+            printf(" | %7.1f ms %5.2f", result.latency / result.settled, (double) result.falseTriggers / SEEDS);
+        } else {
+            printf(" |   never   %5.2f", (double) result.falseTriggers / SEEDS);
+        }
+    }
+    printf("\n");
+}
+
+int main() {
+    printf("step %d -> %d at %d ms, mean over %d noisy traces\n", BEFORE, AFTER, STEP_MS, SEEDS);
+    printf("%-22s | %-16s | %-16s | %-16s\n", "filter", "1 kHz loop", "10 kHz loop", "100 kHz loop");
+    printf("%-22s | %-16s | %-16s | %-16s\n", "", "settle   false", "settle   false", "settle   false");
+    report("tick count (100)", [](Source *s) { return TickBuffer(100, s); });
+    report("hysteresis (150 ms)", [](Source *s) { return Buffer<Source, int, &Source::getRaw>(150, s); });
+    report("majority 8 (150 ms)", [](Source *s) { return MajorityBuffer<Source, int, 8, &Source::getRaw>(150, s); });
+    report("median 7 (150 ms)", [](Source *s) { return MedianBuffer<Source, 7, &Source::getRaw>(150, s); });
+    report("ema (50 ms)", [](Source *s) { return EmaBuffer<Source, &Source::getRaw>(50, s); });
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Replays a corpus of traces on a fleet of simulated boards, across every core of the host.
+ * Each board has its own MicroBit, Simulator and Question 2 state, and replays one trace on recorded time.
+ * Copies of a trace must all end the same way; any that do not are reported, since that means state leaks
+ * between boards.
+ *
+ *   g++ -std=c++11 -O2 -pthread -Ihost host/fleet.cpp -o fleet
+ *   ./fleet [-n copies] [-j threads] host/traces/paradox.trace host/traces/tilted.trace ...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "pool.h"
+#include "replay.h"
+
+struct Board {
+    sim::Simulator simulator;
+    MicroBit uBit;
+    ParadoxThatDrivesUsAll<> paradox;
+
+    Board() : uBit(simulator), paradox(uBit) {}
+};
+
+int main(int argc, char **argv) {
+    unsigned long copies = 1;
+    unsigned threads = 0;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            copies = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = (unsigned) strtoul(argv[++i], NULL, 10);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty() || copies == 0) {
+        fprintf(stderr, "usage: %s [-n copies] [-j threads] trace...\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<std::vector<sim::Keyframe> > traces(paths.size());
+    for (size_t t = 0; t < paths.size(); t++) {
+        if (!sim::readTrace(paths[t], traces[t]) || traces[t].empty()) {
+            fprintf(stderr, "%s is not a trace\n", paths[t]);
+            return 1;
+        }
+    }
+
+    const size_t boards = paths.size() * copies;
+    std::vector<ReplayOutcome> outcomes(boards);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool::run(boards, [&](size_t job, unsigned) {
+        std::unique_ptr<Board> board(new Board());
+        outcomes[job] = replay(traces[job % traces.size()], board->paradox);
+    }, threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned long ticks = 0, simulatedMs = 0, disagreements = 0;
+    for (size_t job = 0; job < boards; job++) {
+        ticks += outcomes[job].ticks;
+        simulatedMs += outcomes[job].simulatedMs;
+        if (outcomes[job].digest != outcomes[job % traces.size()].digest) disagreements++;
+    }
+
+    printf("%-32s %8s %6s %6s %6s %6s %6s %s\n", "trace", "ms", "flips", "turns", "max", "ring", "frames", "digest");
+    for (size_t t = 0; t < paths.size(); t++) {
+        const ReplayOutcome &o = outcomes[t];
+        printf("%-32s %8lu %6lu %6d %6d %6d %6lu %016llx %s\n", paths[t], o.simulatedMs, o.flips, o.turns, o.maxTurns,
+               o.ringStep, o.frameChanges, (unsigned long long) o.digest,
+               o.orientation == VERTICAL ? "vertical" : "horizontal");
+    }
+    printf("%zu boards on %u threads in %.3f s: %.0f simulated ticks/s, %.0fx real time\n", boards,
+           pool::workers(threads), seconds, ticks / seconds, simulatedMs / 1000.0 / seconds);
+    if (disagreements) {
+        printf("%lu boards ended differently from the first copy of their trace\n", disagreements);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Flash and RAM taken by each class of source/main.cpp in a linked firmware, from its symbol table.
+# Exits with 1 if the classes together go over FLASH_BUDGET or RAM_BUDGET bytes, and with 2 if it cannot
+# read the firmware's symbols or finds none from main.cpp among them.
+#
+#   NM=arm-none-eabi-nm host/footprint.sh build/bbc-microbit-classic-gcc/source/lab-1
+#
+# yt build runs it after linking, as the postBuild script in module.json, which fails the build over budget
+# the way the static_asserts in main.cpp do for the arenas. yotta passes no argument then, but names the
+# binaries it built in YOTTA_PRODUCT_BINARIES, and the firmware is the one that is not a .hex or .bin.
+#
+# Works on the host simulator too, to compare changes, though host sizes are larger than the board's.
+# Code the compiler inlined has no symbol of its own and is counted in its caller.
+
+FLASH_BUDGET=${FLASH_BUDGET:-24576}
+RAM_BUDGET=${RAM_BUDGET:-2048}
+SOURCE=$(dirname "$0")/../source/main.cpp
+
+if [ $# -eq 0 ] && [ -n "$YOTTA_PRODUCT_BINARIES" ]; then
+    NM=${NM:-arm-none-eabi-nm}
+    for binary in $(echo "$YOTTA_PRODUCT_BINARIES" | tr ':' ' '); do
+        case "$binary" in
+            *.hex|*.bin) ;;
+            *) set -- "$binary" ;;
+        esac
+    done
+fi
+NM=${NM:-nm}
+
+if [ $# -ne 1 ] || [ ! -f "$1" ]; then
+    echo "usage: [NM=nm] [FLASH_BUDGET=bytes] [RAM_BUDGET=bytes] $0 firmware" >&2
+    exit 2
+fi
+
+# Classes and globals defined in main.cpp; everything else belongs to the runtime.
+names=$( (grep -oE '^(class|struct) [A-Za-z_][A-Za-z0-9_]*' "$SOURCE" | cut -d' ' -f2;
+          grep -oE '^[A-Za-z_][A-Za-z0-9_<>, ]* [A-Za-z_][A-Za-z0-9_]*[[(;]' "$SOURCE" | grep -oE '[A-Za-z0-9_]*.$' | tr -d '[(;') | sort -u)
+
+# Read the symbols first, so that an nm that is missing or cannot read the firmware fails the check.
+if ! symbols=$("$NM" -C -S --size-sort "$1"); then
+    echo "$0: $NM could not read the symbols of $1" >&2
+    exit 2
+fi
+
+printf '%s\n' "$symbols" | awk -v names="$names" -v flashBudget="$FLASH_BUDGET" -v ramBudget="$RAM_BUDGET" '
+function hex(s,    v, i) {
+    v = 0;
+    for (i = 1; i <= length(s); i++) v = v * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1;
+    return v;
+}
+BEGIN {
+    n = split(names, list, "\n");
+    for (i = 1; i <= n; i++) ours[list[i]] = 1;
+}
+NF >= 4 {
+    size = hex($2);
+    if (size == 0) next;
+    type = $3;
+    name = $4;
+    for (i = 5; i <= NF; i++) name = name " " $i;
+    sub(/^(vtable|typeinfo|typeinfo name|guard variable) for /, "", name);
+    # Names too long for nm to demangle, like the generated ring tables, stay mangled; the class is the first name.
+    if (name ~ /^_ZN?[rVK]*[0-9]/) {
+        sub(/^_ZN?[rVK]*/, "", name);
+        chars = name + 0;
+        sub(/^[0-9]+/, "", name);
+        name = substr(name, 1, chars);
+    }
+    # Free function templates are demangled with their return type first.
+    if (name ~ /^[A-Za-z_][A-Za-z0-9_:<>*&]* [A-Za-z_]/ && name !~ /^[A-Za-z_][A-Za-z0-9_]*[<:(]/) sub(/^[^ ]* /, "", name);
+    key = name;
+    sub(/[<:(].*/, "", key);
+    if (!(key in ours)) next;
+    if (type ~ /[TtWwRrVvu]/) flash[key] += size;
+    if (type ~ /[Dd]/) { flash[key] += size; ram[key] += size; }
+    if (type ~ /[Bb]/) ram[key] += size;
+    seen[key] = 1;
+    found = 1;
+}
+END {
+    if (!found) {
+        print "no symbols from main.cpp; is this the firmware, and not stripped?" > "/dev/stderr";
+        exit 2;
+    }
+    printf("%-28s %8s %8s\n", "class", "flash", "ram");
+    for (key in seen) {
+        printf("%-28s %8d %8d\n", key, flash[key], ram[key]) | "sort -k2,2nr";
+        totalFlash += flash[key];
+        totalRam += ram[key];
+    }
+    close("sort -k2,2nr");
+    printf("%-28s %8d %8d\n", "total", totalFlash, totalRam);
+    printf("%-28s %8d %8d\n", "budget", flashBudget, ramBudget);
+    if (totalFlash > flashBudget || totalRam > ramBudget) {
+        print "over budget";
+        exit 1;
+    }
+}'
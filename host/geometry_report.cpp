@@ -0,0 +1,108 @@
+/*
+ * Checks that the ring geometry generated at compile time is consistent, for the board's display and
+ * for other layouts and resolutions, and reports the bytes of flash its tables take.
+ *
+ * For each geometry: the perimeter visits every edge LED once, going round one LED at a time; every LED
+ * has the same number of ring indexes; every arc lights the LEDs between its ends and no others; every
+ * LED is lit by the angle pointing at it; and the index under a continuous angle never skips or goes back
+ * as the angle sweeps through several turns either way.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/geometry_report.cpp -o geometry-report && ./geometry-report
+ */
+#include <math.h>
+#include <stdio.h>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+static Bitboard edgeMask(int w, int h) {
+    Bitboard mask = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            if (x == 0 || y == 0 || x == w - 1 || y == h - 1) mask |= (Bitboard) 1 << (y * w + x);
+        }
+    }
+    return mask;
+}
+
+template <int W, int H, int R>
+static int check() {
+    typedef RingGeometry<W, H, R> G;
+    typedef Ring<G> Arcs;
+    int failures = 0;
+
+    Bitboard seen = 0;
+    for (int p = 0; p < G::LEDS; p++) {
+        if (seen & G::perimeterBit(p)) failures++;
+        seen |= G::perimeterBit(p);
+        if (!G::adjacent(p, (p + 1) % G::LEDS)) failures++;
+    }
+    if (seen != edgeMask(W, H)) failures++;
+
+    int perLed[G::LEDS] = {0};
+    for (int i = 0; i < G::LENGTH; i++) {
+        perLed[G::perimeterOf(i)]++;
+        if (Arcs::arc(i, i) != G::ringBit(i)) failures++;
+        // Every arc is the union of the LEDs of the indexes it spans, and the arc just short of a whole turn lights them all.
+        for (int j = 0; j < G::LENGTH; j++) {
+            Bitboard expected = 0;
+            for (int k = i; ; k = (k + 1) % G::LENGTH) {
+                expected |= G::ringBit(k);
+                if (k == j) break;
+            }
+            if (Arcs::arc(i, j) != expected) failures++;
+        }
+        if (Arcs::arc(i, (i + G::LENGTH - 1) % G::LENGTH) != seen) failures++;
+    }
+    for (int p = 0; p < G::LEDS; p++) {
+        if (perLed[p] != R) failures++;
+    }
+
+    // The angle from the centre of the display to each LED, in binary angle units, finds that LED.
+    for (int p = 0; p < G::LEDS; p++) {
+        const double dx = G::x(p) - (W - 1) / 2.0, dy = G::y(p) - (H - 1) / 2.0;
+        double a = atan2(-dy, -dx);
+        if (a < 0) a += 2 * M_PI;
+        const int32_t angle = (int32_t) (a / (2 * M_PI) * ANGLE_FULL) & (ANGLE_FULL - 1);
+        const int index = Arcs::unwrappedIndex(angle) % G::LENGTH;
+        if (G::perimeterOf(index) != p) {
+            printf("  %dx%d/%d: LED %d (%d, %d) at %.1f degrees reads as index %d\n", W, H, R, p, G::x(p), G::y(p),
+                   a * 180 / M_PI, index);
+            failures++;
+        }
+    }
+
+    // Sweeping through three turns each way, the index only ever steps by one, and every index is reached.
+    int last = Arcs::unwrappedIndex(-3 * ANGLE_FULL);
+    for (int32_t angle = -3 * ANGLE_FULL; angle <= 3 * ANGLE_FULL; angle += 16) {
+        const int index = Arcs::unwrappedIndex(angle);
+        if (index != last && index != last + 1) {
+            printf("  %dx%d/%d: index jumps from %d to %d at angle %d\n", W, H, R, last, index, angle);
+            failures++;
+        }
+        last = index;
+    }
+    if (last - Arcs::unwrappedIndex(-3 * ANGLE_FULL) != 6 * G::LENGTH) failures++;
+
+    char layout[16];
+    snprintf(layout, sizeof(layout), "%dx%d", W, H);
+    printf("%-8s %7d %6d %12zu %12zu  %s\n", layout, R, G::LEDS,
+           sizeof(RingIndexTable<G, typename MakeIndices<1 << RING_TABLE_BITS>::type>::indexes),
+           sizeof(RingArcTable<G, typename MakeIndices<G::LENGTH * G::LENGTH>::type>::masks),
+           failures == 0 ? "ok" : "INCONSISTENT");
+    return failures;
+}
+
+int main() {
+    printf("%-8s %7s %6s %12s %12s\n", "display", "per LED", "LEDs", "angle table", "arc table");
+    int failures = 0;
+    failures += check<BOARD_WIDTH, BOARD_HEIGHT, RING_RESOLUTION>();
+    failures += check<5, 5, 2>();
+    failures += check<5, 5, 3>();
+    failures += check<3, 3, 1>();
+    failures += check<4, 6, 1>();
+    failures += check<6, 4, 2>();
+    failures += check<8, 4, 1>();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/*
+ * Cost, accuracy and step response of HeadingEstimator against the floating point
+ * compass.heading() plus Buffer pipeline it replaces.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/heading_report.cpp -o heading-report && ./heading-report
+ */
+#include <math.h>
+#include <stdio.h>
+#include <random>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "bench.h"
+
+#define SAMPLES 4096
+#define RATE_HZ 50
+#define FIELD_NOISE 300
+
+struct Reading {
+    SensorFrame frame;
+    double field[3];
+    double heading;
+};
+
+static Reading readings[SAMPLES];
+
+// A board tilted by up to 40 degrees, facing a random heading, with noise on the magnetometer.
+static Reading reading(std::mt19937 &rng, double heading, double maxTilt, double noise) {
+    std::uniform_real_distribution<double> tilt(-maxTilt, maxTilt);
+    std::normal_distribution<double> jitter(0, noise > 0 ? noise : 1e-9);
+    const double roll = tilt(rng) * M_PI / 180, pitch = tilt(rng) * M_PI / 180;
+    Reading r;
+    r.heading = heading;
+    r.frame.x = (int) lround(1024 * sin(pitch));
+    r.frame.y = (int) lround(-1024 * cos(pitch) * sin(roll));
+    r.frame.z = (int) lround(-1024 * cos(pitch) * cos(roll));
+    sim::magneticField(r.frame.x, r.frame.y, r.frame.z, heading, r.field);
+    r.frame.mx = (int) lround(r.field[0] + jitter(rng));
+    r.frame.my = (int) lround(r.field[1] + jitter(rng));
+    r.frame.mz = (int) lround(r.field[2] + jitter(rng));
+    return r;
+}
+
+static double error(double a, double b) {
+    double d = fmod(a - b + 540, 360) - 180;
+    return fabs(d);
+}
+
+struct HeadingSource {
+    Reading *reading;
+
+    int getRaw(SensorFrame const& frame) {
+        (void) frame;
+        double f[3] = {(double) reading->frame.mx, (double) reading->frame.my, (double) reading->frame.mz};
+        return sim::tiltCompensatedBearing(reading->frame.x, reading->frame.y, reading->frame.z, f) / 20;
+    }
+};
+
+// Time after the step until the heading is within 10 degrees of 90 and stays there.
+template <class F>
+long stepLatency(F heading) {
+    std::mt19937 rng(1);
+    long settled = -1;
+    for (long t = 0; t < 2000; t += 1000 / RATE_HZ) {
+        Reading r = reading(rng, t < 500 ? 0 : 90, 2, FIELD_NOISE);
+        r.frame.time = t;
+        const double h = heading(r);
+        if (t >= 500 && error(h, 90) <= 10) {
+            if (settled < 0) settled = t - 500;
+        } else {
+            settled = -1;
+        }
+    }
+    return settled;
+}
+
+// Errors of HeadingEstimator over the readings, with the magnetic field scaled by fieldScale.
+static void accuracy(const char *label, int fieldScale) {
+    double maxError = 0, sumError = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        HeadingEstimator<> estimator;
+        SensorFrame frame = readings[i].frame;
+        frame.mx *= fieldScale;
+        frame.my *= fieldScale;
+        frame.mz *= fieldScale;
+        const double h = estimator.update(frame) * 360.0 / ANGLE_FULL;
+        const double e = error(h, readings[i].heading);
+        sumError += e;
+        if (e > maxError) maxError = e;
+    }
+    printf("  %-18s max %.2f deg, mean %.2f deg\n", label, maxError, sumError / SAMPLES);
+}
+
+int main() {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> compass(0, 360);
+    for (int i = 0; i < SAMPLES; i++) readings[i] = reading(rng, compass(rng), 40, 0);
+
+    printf("accuracy over %d headings, tilted up to 40 degrees\n", SAMPLES);
+    accuracy("HeadingEstimator:", 1);
+    // Near a magnet or a steel desk the field can be several times the Earth's.
+    accuracy("at 3x the field:", 3);
+
+    const long iterations = 5000000;
+    HeadingEstimator<> estimator;
+    bench::Timing fixed = bench::measure(iterations, [&estimator](long i) {
+        return (long) estimator.update(readings[i & (SAMPLES - 1)].frame);
+    });
+    bench::Timing reference = bench::measure(iterations, [](long i) {
+        const Reading &r = readings[i & (SAMPLES - 1)];
+        return (long) sim::tiltCompensatedBearing(r.frame.x, r.frame.y, r.frame.z, r.field);
+    });
+    printf("cost per heading\n");
+    printf("  HeadingEstimator::update:    %6.1f ns, %6.1f cycles\n", fixed.nsPerCall, fixed.cyclesPerCall);
+    printf("  floating point tilt bearing: %6.1f ns, %6.1f cycles\n", reference.nsPerCall, reference.cyclesPerCall);
+
+    HeadingEstimator<> stepEstimator;
+    const long fused = stepLatency([&stepEstimator](Reading &r) {
+        return stepEstimator.update(r.frame) * 360.0 / ANGLE_FULL;
+    });
+    HeadingSource source;
+    Buffer<HeadingSource, int, &HeadingSource::getRaw> buffer(150, &source);
+    const long buffered = stepLatency([&source, &buffer](Reading &r) {
+        source.reading = &r;
+        return buffer.value(r.frame) * 20.0 + 10;
+    });
+    printf("step response, 0 to 90 degrees at %d Hz with magnetometer noise\n", RATE_HZ);
+    printf("  HeadingEstimator:                     %4ld ms\n", fused);
+    printf("  compass.heading() / 20 through Buffer: %4ld ms\n", buffered);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Duty cycle and wake-up delay of the adaptive sample rate on recorded traces.
+ *
+ * Each trace is replayed twice through Question 2: once on every recorded sample, and once only on the
+ * samples the board would take at the rate its motion detector asks for. The first gives when a detector
+ * sampling at full rate would have woken, and the second how much later the adaptive board did.
+ * Turns and orientation changes have to come out the same, or the idle rate lost something.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/motion_report.cpp -o motion-report
+ *   ./motion-report host/traces/paradox.trace host/traces/tilted.trace ...
+ */
+#include <stdio.h>
+#include <memory>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "replay.h"
+
+struct Board {
+    sim::Simulator simulator;
+    MicroBit uBit;
+    ParadoxThatDrivesUsAll<> paradox;
+
+    Board() : uBit(simulator), paradox(uBit) {}
+};
+
+struct Outcome {
+    unsigned long samples   = 0;
+    unsigned long taken     = 0; // samples the adaptive board ticked on
+    unsigned long stillMs   = 0;
+    unsigned long wakes     = 0;
+    unsigned long worstWake = 0; // ms from the full rate detector waking to the adaptive board waking
+    unsigned long flips     = 0;
+    int maxTurns            = 0;
+};
+
+static Outcome adaptive(std::vector<sim::Keyframe> const& trace, std::vector<unsigned long> const& fullRateWakes) {
+    Outcome outcome;
+    std::unique_ptr<Board> board(new Board());
+    ParadoxThatDrivesUsAll<> &device = board->paradox;
+    size_t nextWake = 0;
+    bool taken = false;
+    unsigned long last = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const sim::Keyframe &k = trace[i];
+        outcome.samples++;
+        const bool still = device.isStill();
+        if (taken && k.time - last < device.getSamplePeriod()) {
+            if (still) outcome.stillMs += k.time - trace[i - 1].time;
+            continue;
+        }
+        taken = true;
+        last = k.time;
+        outcome.taken++;
+        if (still) outcome.stillMs += i > 0 ? k.time - trace[i - 1].time : 0;
+
+        const Orientation before = device.getOrientation();
+        SensorFrame frame = {k.time, k.ax, k.ay, k.az, k.mx, k.my, k.mz};
+        device.replay(frame);
+        if (device.getOrientation() != before) outcome.flips++;
+        if (device.getTurns() > outcome.maxTurns) outcome.maxTurns = device.getTurns();
+        if (!still || device.isStill()) continue;
+
+        // Woke: measure from the first full rate wake since the board went still.
+        outcome.wakes++;
+        while (nextWake + 1 < fullRateWakes.size() && fullRateWakes[nextWake + 1] <= k.time) nextWake++;
+        if (nextWake < fullRateWakes.size() && fullRateWakes[nextWake] <= k.time) {
+            const unsigned long delay = k.time - fullRateWakes[nextWake];
+            if (delay > outcome.worstWake) outcome.worstWake = delay;
+            nextWake++;
+        }
+    }
+    return outcome;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace...\n", argv[0]);
+        return 2;
+    }
+
+    printf("%-32s %8s %7s %8s %6s %9s %11s %11s\n", "trace", "ms", "still", "samples", "wakes", "worst ms",
+           "turns full", "flips full");
+    unsigned long worst = 0, samples = 0, taken = 0;
+    bool lost = false;
+    for (int t = 1; t < argc; t++) {
+        std::vector<sim::Keyframe> trace;
+        if (!sim::readTrace(argv[t], trace) || trace.empty()) {
+            fprintf(stderr, "%s is not a trace\n", argv[t]);
+            return 1;
+        }
+
+        // Full rate: every sample, with the detector's wake-ups noted.
+        std::unique_ptr<Board> board(new Board());
+        std::vector<unsigned long> wakes;
+        bool still = false;
+        const ReplayOutcome full = replay(trace, board->paradox, [](uint32_t, Bitboard) {});
+        board.reset(new Board());
+        for (size_t i = 0; i < trace.size(); i++) {
+            const sim::Keyframe &k = trace[i];
+            SensorFrame frame = {k.time, k.ax, k.ay, k.az, k.mx, k.my, k.mz};
+            board->paradox.replay(frame);
+            if (still && !board->paradox.isStill()) wakes.push_back(k.time);
+            still = board->paradox.isStill();
+        }
+
+        const Outcome o = adaptive(trace, wakes);
+        const unsigned long ms = trace.back().time - trace.front().time;
+        printf("%-32s %8lu %6.1f%% %7.1f%% %6lu %9lu %5d / %-4d %5lu / %-4lu\n", argv[t], ms,
+               100.0 * o.stillMs / (ms ? ms : 1), 100.0 * o.taken / o.samples, o.wakes, o.worstWake,
+               full.maxTurns, o.maxTurns, full.flips, o.flips);
+        if (o.worstWake > worst) worst = o.worstWake;
+        samples += o.samples;
+        taken += o.taken;
+        if (o.maxTurns != full.maxTurns || o.flips != full.flips) lost = true;
+    }
+    printf("\n%.1f%% of samples taken, worst wake-up %lu ms against a bound of %d ms\n", 100.0 * taken / samples,
+           worst, WAKE_LATENCY);
+    if (lost) {
+        printf("the adaptive rate changed the turns or orientation changes seen\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * How quickly and how steadily Orienter tells horizontal from vertical, against the threshold and
+ * debounce state machine it replaced.
+ *
+ * Both classifiers are run on synthetic sessions labelled with when the board really passed 45 degrees,
+ * the same sessions host/tuner.cpp scores against, and on any recorded traces given. Recorded traces have
+ * no labels, so for them the report lists when each classifier switched.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/orientation_report.cpp -o orientation-report
+ *   ./orientation-report [-t sessions] [-s seed] [trace...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "bench.h"
+#include "scenario.h"
+
+#define LEGACY_HORI_TO_VERT_MARGIN 950
+#define LEGACY_VERT_TO_HORI_MARGIN 950
+#define LEGACY_GRAVITY 1250
+#define LEGACY_ORIENTATION_BUFFER 300
+
+/*
+ * The Orienter this replaces, kept for comparison: |x, y| or |z| against a margin on each raw sample,
+ * debounced by a Buffer.
+ */
+class LegacyOrienter {
+    private:
+        Orientation currOrientation = HORIZONTAL;
+
+        Orientation getRawOrientation(SensorFrame const& frame) {
+            if (currOrientation == HORIZONTAL) {
+                if (Math::squaredMagnitude(frame.x, frame.y) > LEGACY_HORI_TO_VERT_MARGIN * LEGACY_HORI_TO_VERT_MARGIN) {
+                    return VERTICAL;
+                }
+                return HORIZONTAL;
+            } else {
+                if (Math::abs(frame.z) > LEGACY_VERT_TO_HORI_MARGIN) {
+                    return HORIZONTAL;
+                }
+                return VERTICAL;
+            }
+        }
+
+        Buffer<LegacyOrienter, Orientation, &LegacyOrienter::getRawOrientation> orientationBuffer
+            = Buffer<LegacyOrienter, Orientation, &LegacyOrienter::getRawOrientation>(LEGACY_ORIENTATION_BUFFER, this);
+
+        bool largerThanGravity(SensorFrame const& frame) {
+            return Math::squaredMagnitude(frame.x, frame.y, frame.z) > LEGACY_GRAVITY * LEGACY_GRAVITY;
+        }
+    public:
+        Orientation getOrientation() {
+            return currOrientation;
+        }
+
+        bool tick(SensorFrame const& frame) {
+            const Orientation lastOrientation = currOrientation;
+            if (largerThanGravity(frame)) {
+                currOrientation = orientationBuffer.oldValue(frame);
+            }
+            currOrientation = orientationBuffer.value(frame);
+            return currOrientation != lastOrientation;
+        }
+};
+
+static SensorFrame frameOf(sim::Keyframe const& k) {
+    SensorFrame frame = {k.time, k.ax, k.ay, k.az, k.mx, k.my, k.mz};
+    return frame;
+}
+
+// Every switch a classifier makes over a trace.
+template <class O>
+std::vector<Label> switches(std::vector<sim::Keyframe> const& trace) {
+    O orienter;
+    std::vector<Label> detections;
+    for (size_t i = 0; i < trace.size(); i++) {
+        if (!orienter.tick(frameOf(trace[i]))) continue;
+        Label detection = {trace[i].time, orienter.getOrientation()};
+        detections.push_back(detection);
+    }
+    return detections;
+}
+
+struct Result {
+    Score score;
+    unsigned long worst = 0;
+    bench::Timing timing;
+};
+
+template <class O>
+Result evaluate(std::vector<Scenario> const& scenarios) {
+    Result result;
+    for (size_t s = 0; s < scenarios.size(); s++) {
+        Score score;
+        const std::vector<Label> detections = switches<O>(scenarios[s].trace);
+        match(scenarios[s].flips, detections, score);
+        result.score.add(score);
+        // The slowest matched switch, by pairing each label with the first detection of its value after it.
+        for (size_t l = 0; l < scenarios[s].flips.size(); l++) {
+            const Label &label = scenarios[s].flips[l];
+            for (size_t d = 0; d < detections.size(); d++) {
+                if (detections[d].value != label.value || detections[d].time < label.time) continue;
+                const unsigned long delay = detections[d].time - label.time;
+                if (delay <= MATCH_WINDOW_MS && delay > result.worst) result.worst = delay;
+                break;
+            }
+        }
+    }
+    const std::vector<sim::Keyframe> &trace = scenarios[0].trace;
+    O orienter;
+    result.timing = bench::measure((long) trace.size() * 200, [&](long i) {
+        return (long) orienter.tick(frameOf(trace[i % trace.size()]));
+    });
+    return result;
+}
+
+static void row(const char *name, Result const& r) {
+    printf("%-8s %10.1f %9lu %8lu %9.1f %9.1f\n", name, r.score.meanLatency(), r.worst, r.score.falses,
+           r.timing.nsPerCall, r.timing.cyclesPerCall);
+}
+
+int main(int argc, char **argv) {
+    int sessions = 64;
+    uint64_t seed = 1;
+    int first = 1;
+    while (first + 1 < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-t") == 0) sessions = atoi(argv[first + 1]);
+        else if (strcmp(argv[first], "-s") == 0) seed = strtoull(argv[first + 1], NULL, 10);
+        first += 2;
+    }
+    if (sessions <= 0) {
+        fprintf(stderr, "usage: %s [-t sessions] [-s seed] [trace...]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Scenario> scenarios(sessions);
+    unsigned long flips = 0;
+    for (int i = 0; i < sessions; i++) {
+        Random random(seed + i);
+        ScenarioBuilder(random, scenarios[i]).build(12);
+        flips += scenarios[i].flips.size();
+    }
+    const Result legacy = evaluate<LegacyOrienter>(scenarios);
+    const Result current = evaluate<Orienter<> >(scenarios);
+    printf("%d sessions, %lu orientation changes\n\n", sessions, flips);
+    printf("%-8s %10s %9s %8s %9s %9s\n", "", "mean ms", "worst ms", "false", "ns/tick", "cyc/tick");
+    row("legacy", legacy);
+    row("Orienter", current);
+
+    unsigned long ticks = 0, unsure = 0, total = 0;
+    for (int i = 0; i < sessions; i++) {
+        Orienter<> orienter;
+        for (size_t k = 0; k < scenarios[i].trace.size(); k++) {
+            orienter.tick(frameOf(scenarios[i].trace[k]));
+            const int confidence = orienter.getConfidence();
+            ticks++;
+            total += confidence;
+            if (confidence < 50) unsure++;
+        }
+    }
+    printf("\nOrienter's confidence is %lu%% on average, and under 50%% on %.1f%% of ticks\n", total / ticks,
+           100.0 * unsure / ticks);
+
+    for (int t = first; t < argc; t++) {
+        std::vector<sim::Keyframe> trace;
+        if (!sim::readTrace(argv[t], trace) || trace.empty()) {
+            fprintf(stderr, "%s is not a trace\n", argv[t]);
+            return 1;
+        }
+        const std::vector<Label> before = switches<LegacyOrienter>(trace);
+        const std::vector<Label> after = switches<Orienter<> >(trace);
+        printf("\n%s: %zu switches before, %zu after\n", argv[t], before.size(), after.size());
+        for (size_t i = 0; i < before.size() || i < after.size(); i++) {
+            char left[32] = "", right[32] = "";
+            if (i < before.size()) {
+                snprintf(left, sizeof(left), "%-10s %6lu", before[i].value == VERTICAL ? "vertical" : "horizontal",
+                         before[i].time - trace.front().time);
+            }
+            if (i < after.size()) {
+                snprintf(right, sizeof(right), "%-10s %6lu", after[i].value == VERTICAL ? "vertical" : "horizontal",
+                         after[i].time - trace.front().time);
+            }
+            printf("  %-20s %-20s", left, right);
+            if (i < before.size() && i < after.size() && before[i].value == after[i].value) {
+                printf(" %+ld ms", (long) after[i].time - (long) before[i].time);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef HOST_POOL_H
+#define HOST_POOL_H
+
+/*
+ * A work-stealing pool for running independent jobs on every core of the host.
+ *
+ * Jobs are dealt round robin onto one queue per worker. A worker takes jobs from the front of its own
+ * queue, and once that runs dry, steals from the back of the others', so that a few long jobs
+ * landing on one worker do not hold up the whole run.
+ */
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pool {
+
+class Queue {
+    private:
+        std::deque<size_t> jobs;
+        std::mutex lock;
+    public:
+        void push(size_t job) {
+            std::lock_guard<std::mutex> guard(lock);
+            jobs.push_back(job);
+        }
+
+        bool takeFront(size_t &job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (jobs.empty()) return false;
+            job = jobs.front();
+            jobs.pop_front();
+            return true;
+        }
+
+        bool stealBack(size_t &job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (jobs.empty()) return false;
+            job = jobs.back();
+            jobs.pop_back();
+            return true;
+        }
+};
+
+inline unsigned workers(unsigned requested = 0) {
+    if (requested > 0) return requested;
+    const unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+/*
+ * Runs job(index, worker) for every index below count, and returns once they have all finished.
+ * Nothing is added once the run starts, so a worker that finds every queue empty is done.
+ * @param threads the number of workers, or 0 for one per core
+ */
+template <class F>
+void run(size_t count, F job, unsigned threads = 0) {
+    threads = workers(threads);
+    std::vector<Queue> queues(threads);
+    for (size_t i = 0; i < count; i++) queues[i % threads].push(i);
+
+    std::vector<std::thread> pool;
+    for (unsigned w = 0; w < threads; w++) {
+        pool.push_back(std::thread([&queues, &job, threads, w]() {
+            size_t index;
+            while (1) {
+                bool found = queues[w].takeFront(index);
+                for (unsigned v = 1; !found && v < threads; v++) found = queues[(w + v) % threads].stealBack(index);
+                if (!found) return;
+                job(index, w);
+            }
+        }));
+    }
+    for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+}
+
+} // namespace pool
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef HOST_REPLAY_H
+#define HOST_REPLAY_H
+
+/*
+ * Replays a recorded trace through Question 2's logic on recorded time, for the host tools.
+ * Include after source/main.cpp.
+ */
+#include <stdint.h>
+#include <vector>
+
+struct ReplayOutcome {
+    unsigned long ticks        = 0;
+    unsigned long simulatedMs  = 0;
+    unsigned long frameChanges = 0;
+    unsigned long flips        = 0; // changes between horizontal and vertical
+    int maxTurns               = 0;
+    int turns                  = 0; // at the end of the trace
+    int ringStep               = 0; // at the end of the trace
+    Orientation orientation    = HORIZONTAL;
+    uint64_t digest            = 14695981039346656037ULL; // FNV-1a over the time and contents of every frame change
+};
+
+/*
+ * Ticks device, a ParadoxThatDrivesUsAll of any configuration, on every record of trace,
+ * and renders every RENDER_PERIOD of recorded time.
+ * @param onFrame called with the time since the start of the trace and the frame, whenever the frame changes
+ */
+template <class D, class F>
+ReplayOutcome replay(std::vector<sim::Keyframe> const& trace, D &device, F onFrame) {
+    ReplayOutcome outcome;
+    if (trace.empty()) return outcome;
+    const unsigned long start = trace.front().time;
+    unsigned long nextRender = start;
+    Bitboard shown = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const sim::Keyframe &k = trace[i];
+        SensorFrame frame = {k.time, k.ax, k.ay, k.az, k.mx, k.my, k.mz};
+        const Orientation before = device.getOrientation();
+        device.replay(frame);
+        outcome.ticks++;
+        if (device.getOrientation() != before) outcome.flips++;
+        if (device.getTurns() > outcome.maxTurns) outcome.maxTurns = device.getTurns();
+
+        if (k.time < nextRender) continue;
+        nextRender = k.time + RENDER_PERIOD;
+        device.render();
+        const Bitboard current = device.getFrame();
+        if (outcome.frameChanges > 0 && current == shown) continue;
+        shown = current;
+        outcome.frameChanges++;
+        const uint32_t at = (uint32_t) (k.time - start);
+        const uint32_t words[2] = {at, current};
+        const uint8_t *bytes = (const uint8_t *) words;
+        for (size_t b = 0; b < sizeof(words); b++) outcome.digest = (outcome.digest ^ bytes[b]) * 1099511628211ULL;
+        onFrame(at, current);
+    }
+    outcome.simulatedMs = trace.back().time - start;
+    outcome.turns       = device.getTurns();
+    outcome.ringStep    = device.getRingStep();
+    outcome.orientation = device.getOrientation();
+    return outcome;
+}
+
+template <class D>
+ReplayOutcome replay(std::vector<sim::Keyframe> const& trace, D &device) {
+    return replay(trace, device, [](uint32_t, Bitboard) {});
+}
+
+#endif
@@ -0,0 +1,892 @@
+/*
+ * Property-based stress test of the turn counting and ring state machines of Question 2.
+ *
+ * Each run is a random trajectory of spins, rolls, reversals, holds, tilts to the edge and stands, at random
+ * speeds, with jitter and single-sample noise spikes on the sensors. The trajectory carries its ground
+ * truth, the angle the board really turned through, and four subjects are checked against it:
+ *
+ *   tracker     RotationTracker on the heading itself: unwraps exactly, and keeps its turns within
+ *               TURN_HYSTERESIS of the angle.
+ *   horizontal  HorizontalParadox on the sensors of a flat board: the number stays from 0 to 9, and once
+ *               the board has settled it counts the whole turns the true heading has made since the start
+ *               or the last edge, stopping at 0 and 9.
+ *   vertical    VerticalParadox on the sensors of a standing board: once settled, the ring is as long as the
+ *               true roll, and lights exactly the LEDs from where it started.
+ *   paradox     The whole of Question 2 on a simulated board, sampling the sensors itself, on flat trajectories
+ *               that stand the board up: it counts as horizontal does, from where the board lies down again.
+ *               It ticks on samples up to STALE_MS either side of the one checked, so it is allowed that much
+ *               more of the turn, and it is only checked on trajectories no faster than MAX_TURN_RATE.
+ *
+ * The firmware estimates angles from noisy sensors, so the truth allows any behaviour an angle up to
+ * TOLERANCE degrees out could have caused around a turn or LED boundary, and nothing more. Tilting the
+ * board moves the field faster than the heavily smoothed gravity, so for a while after a tilt the heading
+ * may be out by up to TILT_TOLERANCE, or STAND_TOLERANCE after standing up, and while it turns the filters trail
+ * it by LAG_SAMPLES of the turn.
+ * Circular::compare and flow are also checked exhaustively for small radices.
+ *
+ * Trajectories run on every core. Each property that fails is reported once, for the lowest seed that
+ * broke it, shrunk to the fewest segments, spikes and noise that still break it, and written out as a
+ * sensor script with a truth column. The script runs in the simulator, and -r replays it here.
+ *
+ *   g++ -std=c++11 -O2 -pthread -Ihost host/rotation_fuzzer.cpp -o rotation-fuzzer
+ *   ./rotation-fuzzer [-n trajectories] [-j threads] [-s seed] [-o directory]
+ *   ./rotation-fuzzer -r fuzz-horizontal-1234.txt
+ */
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "pool.h"
+#include "scenario.h"
+
+#define TOLERANCE 6          // Degrees the firmware's estimate of an angle may be out by
+#define TILT_TOLERANCE 25    // Degrees the heading may be out by while gravity catches up with a tilt
+#define STAND_TOLERANCE 45   // and with the board standing up, or lying down again
+#define TILT_SETTLE_MS 500   // How long after a tilt the heading may still be out by that much
+#define LAG_SAMPLES 2        // Samples the filtered heading and roll trail a turn by
+#define SETTLE_MS 500        // Holds at least this long end with a check of the settled state
+#define EDGE_TILT 600        // mg towards an edge, past the 2 * TILT_SENS that resets the number
+#define STAND_TILT 1000      // mg towards an edge, enough to stand the board up
+#define STALE_MS WAKE_LATENCY // How far the live firmware's latest reading may be from the sample it is checked at
+#define EDGE_LAG_MS (Config::TILT_BUFFER + 2 * SAMPLE_MS) // How long after leaving an edge the count may start again
+#define MAX_SPIN_RATE 1500   // Degrees per second, under the half turn a sample RotationTracker can follow
+#define HYSTERESIS_DEGREES (TURN_HYSTERESIS * 360.0 / ANGLE_FULL)
+
+struct Sample {
+    unsigned long time;
+    int ax, ay, az;
+    int heading;       // degrees, as the magnetometer would give it, with jitter and spikes
+    double truth;      // degrees the board has really turned to, heading when flat and roll when standing
+    bool edge;         // really tilted to an edge
+    double tolerance;  // degrees the firmware's estimate of truth may be out by
+    bool check;        // the end of a settled hold
+};
+
+struct Segment {
+    enum Kind { HOLD, TURN, EDGE, STAND } kind;
+    double degrees;          // TURN: how far, clockwise positive
+    double rate;             // TURN: degrees per second
+    unsigned long ms;        // HOLD, EDGE and STAND: how long
+    int direction;           // EDGE and STAND: 0 to 3, for +x, -x, +y, -y
+};
+
+struct Spike {
+    size_t at;               // sample index
+    int axis;                // 0 to 2 for the accelerometer, 3 for the heading
+    int amount;
+};
+
+struct Plan {
+    uint64_t seed;
+    bool standing;
+    double start;            // degrees
+    std::vector<Segment> segments;
+    double jitter;           // degrees of heading or roll noise either way
+    int accelJitter;         // mg either way
+    std::vector<Spike> spikes;
+};
+
+struct Failure {
+    std::string subject;
+    std::string property;
+    size_t at = 0;
+    std::string detail;
+
+    bool failed() const {
+        return !subject.empty();
+    }
+};
+
+static Failure fail(const char *subject, const char *property, size_t at, const char *format, ...) {
+    Failure f;
+    f.subject = subject;
+    f.property = property;
+    f.at = at;
+    char detail[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(detail, sizeof(detail), format, args);
+    va_end(args);
+    f.detail = detail;
+    return f;
+}
+
+// MARK: Trajectories
+
+static Plan randomPlan(uint64_t seed) {
+    Random random(seed);
+    Plan plan;
+    plan.seed = seed;
+    plan.standing = random.chance(0.4);
+    plan.start = random.uniform(0, 360);
+    plan.jitter = random.chance(0.3) ? 0 : random.uniform(0, 3);
+    plan.accelJitter = random.between(0, 40);
+
+    Segment first = {Segment::HOLD, 0, 0, (unsigned long) random.between(300, 800), 0};
+    plan.segments.push_back(first);
+    const int segments = random.between(2, 12);
+    for (int i = 0; i < segments; i++) {
+        Segment s = {Segment::HOLD, 0, 0, 0, 0};
+        const double pick = random.uniform(0, 1);
+        if (pick < 0.55) {
+            s.kind = Segment::TURN;
+            s.degrees = random.uniform(10, 800) * (random.chance(0.5) ? 1 : -1);
+            s.rate = random.uniform(30, MAX_SPIN_RATE);
+        } else if (pick < 0.85 || plan.standing) {
+            s.ms = (unsigned long) random.between(50, 1500);
+        } else {
+            s.kind = random.chance(0.5) ? Segment::EDGE : Segment::STAND;
+            s.ms = (unsigned long) random.between(300, 1000);
+            s.direction = random.between(0, 3);
+        }
+        plan.segments.push_back(s);
+    }
+    Segment last = {Segment::HOLD, 0, 0, SETTLE_MS + 300, 0};
+    plan.segments.push_back(last);
+    // The whole firmware follows no more than MAX_TURN_RATE, sampling slowly until it sees the board move.
+    bool stands = false;
+    for (size_t i = 0; i < plan.segments.size(); i++) stands = stands || plan.segments[i].kind == Segment::STAND;
+    for (size_t i = 0; i < plan.segments.size() && stands; i++) {
+        plan.segments[i].rate = std::min(plan.segments[i].rate, (double) MAX_TURN_RATE);
+    }
+
+    if (random.chance(0.5)) {
+        const int spikes = random.between(1, 4);
+        for (int i = 0; i < spikes; i++) {
+            Spike spike;
+            spike.at = (size_t) random.between(50, 600);
+            spike.axis = random.between(0, 3);
+            spike.amount = spike.axis == 3 ? random.between(10, 90) : random.between(200, 1000);
+            if (random.chance(0.5)) spike.amount = -spike.amount;
+            // The filters drop a single bad sample out of any three, so spikes are kept that far apart.
+            bool isolated = true;
+            for (size_t k = 0; k < plan.spikes.size(); k++) {
+                if (labs((long) plan.spikes[k].at - (long) spike.at) < 3) isolated = false;
+            }
+            if (isolated) plan.spikes.push_back(spike);
+        }
+    }
+    return plan;
+}
+
+/*
+ * Fixed trajectories for bugs found before, checked on every run ahead of the random ones.
+ */
+static std::vector<Plan> regressions() {
+    std::vector<Plan> plans;
+    Plan plan;
+    plan.seed = 0;
+    plan.standing = false;
+    plan.jitter = 0;
+    plan.accelJitter = 0;
+
+    // Wobbling back past the hysteresis below 0 and returning a little past the start must not count a turn up.
+    plan.start = 328.5;
+    const Segment wobbleAtZero[] = {
+        {Segment::HOLD, 0, 0, 600, 0},
+        {Segment::TURN, -25, 200, 0, 0},
+        {Segment::HOLD, 0, 0, 300, 0},
+        {Segment::TURN, 40, 200, 0, 0},
+        {Segment::HOLD, 0, 0, SETTLE_MS + 300, 0}
+    };
+    plan.segments.assign(wobbleAtZero, wobbleAtZero + 5);
+    plans.push_back(plan);
+
+    // Nor may turning past 9 and back one turn count a turn down.
+    plan.start = 15;
+    const Segment turnBackFromNine[] = {
+        {Segment::HOLD, 0, 0, 600, 0},
+        {Segment::TURN, 10 * 360 + 30, 1000, 0, 0},
+        {Segment::HOLD, 0, 0, 300, 0},
+        {Segment::TURN, -360, 500, 0, 0},
+        {Segment::HOLD, 0, 0, SETTLE_MS + 300, 0}
+    };
+    plan.segments.assign(turnBackFromNine, turnBackFromNine + 5);
+    plans.push_back(plan);
+
+    // Turning clockwise after turning back past 0 counts from where the board turned back to.
+    plan.start = 200;
+    const Segment overturnBelowZero[] = {
+        {Segment::HOLD, 0, 0, 600, 0},
+        {Segment::TURN, -720, 800, 0, 0},
+        {Segment::HOLD, 0, 0, 300, 0},
+        {Segment::TURN, 420, 800, 0, 0},
+        {Segment::HOLD, 0, 0, SETTLE_MS + 300, 0}
+    };
+    plan.segments.assign(overturnBelowZero, overturnBelowZero + 5);
+    plans.push_back(plan);
+
+    // Lying back down, the count starts from a fresh heading, not from the field last read as the board stood up.
+    plan.start = 60;
+    const Segment standThenTurn[] = {
+        {Segment::HOLD, 0, 0, 600, 0},
+        {Segment::STAND, 0, 0, 1000, 3},
+        {Segment::HOLD, 0, 0, 300, 0},
+        {Segment::TURN, 250, 90, 0, 0},
+        {Segment::HOLD, 0, 0, SETTLE_MS + 300, 0}
+    };
+    plan.segments.assign(standThenTurn, standThenTurn + 5);
+    plans.push_back(plan);
+    return plans;
+}
+
+class TrajectoryBuilder {
+    private:
+        Plan const& plan;
+        Random noise;
+        std::vector<Sample> &samples;
+        unsigned long time = 0;
+        double angle;
+        double tiltX = 0, tiltY = 0;
+        bool edge = false;
+        int settling = 0;   // samples until the heading has caught up with the last tilt
+        double settlingTolerance = TILT_TOLERANCE;
+        double lag = 0;     // degrees the filters trail the turn in progress by
+
+        void emit(bool check = false) {
+            Sample s;
+            s.time = time;
+            s.truth = angle;
+            s.edge = edge;
+            s.check = check;
+            s.tolerance = (settling > 0 ? settlingTolerance : TOLERANCE) + lag;
+            if (settling > 0) settling--;
+            const double jitter = plan.jitter > 0 ? noise.uniform(-plan.jitter, plan.jitter) : 0;
+            const int aj = plan.accelJitter;
+            if (plan.standing) {
+                const double a = (angle + jitter) * M_PI / 180;
+                s.ax = (int) lround(1024 * cos(a)) + noise.between(-aj, aj);
+                s.ay = (int) lround(1024 * sin(a)) + noise.between(-aj, aj);
+                s.az = noise.between(-aj, aj);
+                s.heading = 0;
+            } else {
+                s.ax = (int) lround(tiltX) + noise.between(-aj, aj);
+                s.ay = (int) lround(tiltY) + noise.between(-aj, aj);
+                s.az = (int) lround(-sqrt(1024.0 * 1024 - tiltX * tiltX - tiltY * tiltY)) + noise.between(-aj, aj);
+                s.heading = (int) lround(angle + jitter);
+            }
+            samples.push_back(s);
+            time += SAMPLE_MS;
+        }
+
+        void tilt(double x, double y, unsigned long ms) {
+            const double x0 = tiltX, y0 = tiltY;
+            for (unsigned long t = 0; t < ms; t += SAMPLE_MS) {
+                tiltX = x0 + (x - x0) * t / ms;
+                tiltY = y0 + (y - y0) * t / ms;
+                edge = fabs(tiltX) >= 2 * Config::TILT_SENS || fabs(tiltY) >= 2 * Config::TILT_SENS;
+                settling = TILT_SETTLE_MS / SAMPLE_MS;
+                emit();
+            }
+            tiltX = x;
+            tiltY = y;
+            edge = fabs(tiltX) >= 2 * Config::TILT_SENS || fabs(tiltY) >= 2 * Config::TILT_SENS;
+        }
+
+        void hold(unsigned long ms) {
+            const size_t samples = ms / SAMPLE_MS;
+            for (size_t i = 0; i < samples; i++) emit(ms >= SETTLE_MS && i + 1 == samples);
+        }
+    public:
+        TrajectoryBuilder(Plan const& plan, std::vector<Sample> &samples)
+            : plan(plan), noise(plan.seed * 31 + 7), samples(samples), angle(plan.start) {}
+
+        void run() {
+            for (size_t i = 0; i < plan.segments.size(); i++) {
+                const Segment &s = plan.segments[i];
+                if (s.kind == Segment::HOLD) {
+                    hold(s.ms);
+                } else if (s.kind == Segment::TURN) {
+                    const double step = s.rate * SAMPLE_MS / 1000;
+                    const double target = angle + s.degrees;
+                    lag = LAG_SAMPLES * step;
+                    while (fabs(target - angle) > step) {
+                        angle += target > angle ? step : -step;
+                        emit();
+                    }
+                    angle = target;
+                    emit();
+                    lag = 0;
+                } else {
+                    const double amount = s.kind == Segment::EDGE ? EDGE_TILT : STAND_TILT;
+                    settlingTolerance = s.kind == Segment::EDGE ? TILT_TOLERANCE : STAND_TOLERANCE;
+                    const double x = s.direction == 0 ? amount : s.direction == 1 ? -amount : 0;
+                    const double y = s.direction == 2 ? amount : s.direction == 3 ? -amount : 0;
+                    tilt(x, y, 200);
+                    hold(s.ms);
+                    tilt(0, 0, 200);
+                }
+            }
+            for (size_t i = 0; i < plan.spikes.size(); i++) {
+                const Spike &spike = plan.spikes[i];
+                if (spike.at >= samples.size()) continue;
+                Sample &s = samples[spike.at];
+                if (spike.axis == 0) s.ax += spike.amount;
+                if (spike.axis == 1) s.ay += spike.amount;
+                if (spike.axis == 2) s.az += spike.amount;
+                if (spike.axis == 3 && !plan.standing) s.heading += spike.amount;
+            }
+        }
+};
+
+static std::vector<Sample> render(Plan const& plan) {
+    std::vector<Sample> samples;
+    TrajectoryBuilder(plan, samples).run();
+    return samples;
+}
+
+static SensorFrame frameOf(Sample const& s) {
+    double field[3];
+    sim::magneticField(s.ax, s.ay, s.az, s.heading, field);
+    SensorFrame frame = {s.time, s.ax, s.ay, s.az, (int) lround(field[0]), (int) lround(field[1]), (int) lround(field[2])};
+    return frame;
+}
+
+// MARK: Subjects
+
+static int32_t binaryAngle(double degrees) {
+    return (int32_t) llround(degrees * ANGLE_FULL / 360);
+}
+
+static Failure checkTracker(std::vector<Sample> const& samples) {
+    RotationTracker tracker;
+    const int32_t start = binaryAngle(samples[0].heading);
+    int lastTurns = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const int32_t angle = tracker.unwrap((uint16_t) (binaryAngle(samples[i].heading) & (ANGLE_FULL - 1)));
+        tracker.countTurns();
+        const int32_t expected = binaryAngle(samples[i].heading) - start;
+        if (angle - tracker.getStart() != expected) {
+            return fail("tracker", "unwraps exactly", i, "unwrapped %d from the start, the heading moved %d",
+                        angle - tracker.getStart(), expected);
+        }
+        const int turns = tracker.getTurns();
+        if (expected > (int32_t) (turns + 1) * ANGLE_FULL + TURN_HYSTERESIS
+                || expected < (int32_t) turns * ANGLE_FULL - TURN_HYSTERESIS) {
+            return fail("tracker", "turns follow the angle", i, "%d turns at %d from the start", turns, expected);
+        }
+        // A turn is counted once the angle is past the hysteresis, and undone once it is back past it.
+        if ((turns > lastTurns && expected <= (int32_t) turns * ANGLE_FULL + TURN_HYSTERESIS)
+                || (turns < lastTurns && expected >= (int32_t) (turns + 1) * ANGLE_FULL - TURN_HYSTERESIS)) {
+            return fail("tracker", "turns need the hysteresis", i, "%d turns at %d from the start", turns, expected);
+        }
+        lastTurns = turns;
+    }
+    return Failure();
+}
+
+/*
+ * Every number the display may show, followed from the true angle rather than from the firmware's estimate.
+ * The count is the whole turns since a base angle, within the hysteresis either side, from 0 to 9. The base
+ * stays put until the board turns past either end: more than the hysteresis back from it, or past a tenth
+ * turn, when it is dragged along so that the count starts again from 0 or 9 where the board is.
+ * The estimate may be up to a sample's tolerance out, so the base is only known to within a range. Any base
+ * in it that would have been dragged by an estimate within the tolerance is followed both ways.
+ */
+class CountOracle {
+    private:
+        double low = 0, high = 0; // degrees the base may be at
+        bool edged = false;
+        unsigned long edgeAt = 0; // the last sample at an edge
+    public:
+        // Counting starts again from 0 at degrees, known to within tolerance.
+        void restart(double degrees, double tolerance) {
+            low = degrees - tolerance;
+            high = degrees + tolerance;
+        }
+
+        // Counting may have started again from degrees, or carried on.
+        void mayRestart(double degrees, double tolerance) {
+            low = std::min(low, degrees - tolerance);
+            high = std::max(high, degrees + tolerance);
+        }
+
+        /*
+         * Follows the board to a sample, which the firmware's estimate may be tolerance out from.
+         * The firmware sees the board leave an edge up to lagMs late, and starts counting again from there.
+         */
+        void follow(Sample const& sample, double tolerance, unsigned long lagMs) {
+            if (sample.edge) {
+                restart(sample.truth, tolerance);
+                edged = true;
+                edgeAt = sample.time;
+                return;
+            }
+            update(sample.truth, tolerance);
+            if (edged && sample.time - edgeAt <= lagMs) mayRestart(sample.truth, tolerance);
+        }
+
+        void update(double degrees, double tolerance) {
+            const double h = HYSTERESIS_DEGREES;
+            const double least = degrees - tolerance, most = degrees + tolerance;
+            // Dragged down by an estimate more than the hysteresis below the base, to the estimate.
+            if (least < high - h) {
+                const double draggedLow = least, draggedHigh = std::min(most, high - h);
+                if (most < low - h) {
+                    low = draggedLow;
+                    high = draggedHigh;
+                } else {
+                    high = std::min(high, most + h);
+                    low = std::min(low, draggedLow);
+                    high = std::max(high, draggedHigh);
+                }
+            }
+            // Dragged up by an estimate past a tenth turn, to nine turns below the estimate.
+            const double top = 10 * 360 + h;
+            if (most - low > top) {
+                const double draggedLow = std::max(least, low + top) - 9 * 360, draggedHigh = most - 9 * 360;
+                if (least - high > top) {
+                    low = draggedLow;
+                    high = draggedHigh;
+                } else {
+                    low = std::max(low, least - top);
+                    low = std::min(low, draggedLow);
+                    high = std::max(high, draggedHigh);
+                }
+            }
+        }
+
+        // The lowest and highest numbers an estimate of degrees within tolerance could show.
+        void range(double degrees, double tolerance, int &shownLow, int &shownHigh) const {
+            const double h = HYSTERESIS_DEGREES;
+            shownLow = std::min(std::max((int) ceil((degrees - tolerance - high - h) / 360) - 1, 0), 9);
+            shownHigh = std::min(std::max((int) floor((degrees + tolerance - low + h) / 360), 0), 9);
+        }
+};
+
+struct Board {
+    sim::Simulator simulator;
+    MicroBit uBit;
+    Renderer renderer;
+
+    Board() : uBit(simulator), renderer(uBit) {}
+};
+
+static Failure checkHorizontal(std::vector<Sample> const& samples) {
+    std::unique_ptr<Board> board(new Board());
+    HorizontalParadox<> paradox(board->renderer, samples[0].time);
+    // The count starts from the first heading, and again from wherever the board leaves an edge.
+    CountOracle oracle;
+    oracle.restart(samples[0].truth, TOLERANCE);
+    const double start = samples[0].truth;
+    for (size_t i = 0; i < samples.size(); i++) {
+        paradox.tick(frameOf(samples[i]));
+        oracle.follow(samples[i], samples[i].tolerance, EDGE_LAG_MS);
+        const int shown = paradox.getTurns();
+        if (shown < 0 || shown > 9) return fail("horizontal", "shows 0 to 9", i, "shows %d", shown);
+        if (!samples[i].check) continue;
+        int low, high;
+        if (samples[i].edge) low = high = 0;
+        else oracle.range(samples[i].truth, samples[i].tolerance, low, high);
+        if (shown < low || shown > high) {
+            return fail("horizontal", "counts the true turns", i, "shows %d, %.1f degrees from the start should show %d to %d",
+                        shown, samples[i].truth - start, low, high);
+        }
+    }
+    return Failure();
+}
+
+// Question 2 on a board of its own, reading the trajectory through the simulator's sensors.
+struct Device {
+    sim::Simulator simulator;
+    MicroBit uBit;
+    ParadoxThatDrivesUsAll<> paradox;
+
+    Device() : uBit(simulator), paradox(uBit) {}
+};
+
+// Whether the whole firmware is checked on a flat trajectory: one that stands up, no faster than it can follow.
+static bool livePlan(std::vector<Sample> const& samples) {
+    const double standing = 1024 * sin(Config::VERTICAL_TILT * M_PI / 180);
+    const double fastest = MAX_TURN_RATE * SAMPLE_MS / 1000.0 + 1e-6;
+    bool stands = false;
+    for (size_t i = 0; i < samples.size(); i++) {
+        stands = stands || hypot(samples[i].ax, samples[i].ay) > standing;
+        if (i > 0 && fabs(samples[i].truth - samples[i - 1].truth) > fastest) return false;
+    }
+    return stands;
+}
+
+/*
+ * The simulator works out the magnetometer from the scripted pose, and the firmware reads each compass sample on
+ * two ticks, so a spike would be a real tilt held for two samples rather than a glitch. Spikes are taken out with a
+ * median of three, which the other subjects check the filters against.
+ */
+static Failure checkParadox(std::vector<Sample> const& samples) {
+    std::vector<sim::Keyframe> script;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample &before = samples[i > 0 ? i - 1 : i], &after = samples[i + 1 < samples.size() ? i + 1 : i];
+        sim::Keyframe k = sim::Keyframe();
+        k.time = samples[i].time;
+        k.ax = Math::median(before.ax, samples[i].ax, after.ax);
+        k.ay = Math::median(before.ay, samples[i].ay, after.ay);
+        k.az = Math::median(before.az, samples[i].az, after.az);
+        k.heading = Math::median(before.heading, samples[i].heading, after.heading);
+        script.push_back(k);
+    }
+    std::unique_ptr<Device> device(new Device());
+    device->simulator.play(script);
+    device->paradox.begin();
+    CountOracle oracle;
+    oracle.restart(samples[0].truth, TOLERANCE);
+    const double start = samples[0].truth;
+    size_t first = 0, last = 0; // the samples within STALE_MS of this one
+    for (size_t i = 0; i < samples.size(); i++) {
+        while (device->uBit.systemTime() < samples[i].time) device->paradox.runNext();
+        while (samples[first].time + STALE_MS < samples[i].time) first++;
+        while (last + 1 < samples.size() && samples[last + 1].time <= samples[i].time + STALE_MS) last++;
+        double stale = 0;
+        for (size_t k = first; k <= last; k++) stale = std::max(stale, fabs(samples[k].truth - samples[i].truth));
+        const double tolerance = samples[i].tolerance + stale;
+        oracle.follow(samples[i], samples[i].edge ? samples[i].tolerance : tolerance, EDGE_LAG_MS + STALE_MS);
+        const int shown = device->paradox.getTurns();
+        if (shown < 0 || shown > 9) return fail("paradox", "shows 0 to 9", i, "shows %d", shown);
+        if (!samples[i].check) continue;
+        int low, high;
+        if (samples[i].edge) low = high = 0;
+        else oracle.range(samples[i].truth, tolerance, low, high);
+        if (shown < low || shown > high) {
+            return fail("paradox", "counts the true turns", i, "shows %d, %.1f degrees from the start should show %d to %d",
+                        shown, samples[i].truth - start, low, high);
+        }
+    }
+    return Failure();
+}
+
+// The ring index under an angle in degrees, worked out in floating point straight from the geometry.
+static int trueIndex(double degrees) {
+    const double turns = floor(degrees / 360);
+    const double within = (degrees - turns * 360) * M_PI / 180;
+    return (int) turns * BoardRing::LENGTH + BoardRing::indexAtAngle(within);
+}
+
+// The ring drawn from initial for step LEDs, walking it an index at a time.
+static Bitboard walkRing(int initial, int step) {
+    const int length = abs(step) % BoardRing::LENGTH;
+    if (length == BoardRing::LENGTH - 1) return 0;
+    Bitboard frame = 0;
+    for (int k = 0; k <= length; k++) {
+        frame |= BoardRing::ringBit(((initial + (step >= 0 ? k : -k)) % BoardRing::LENGTH + BoardRing::LENGTH)
+                                    % BoardRing::LENGTH);
+    }
+    return frame;
+}
+
+static Failure checkVertical(std::vector<Sample> const& samples) {
+    std::unique_ptr<Board> board(new Board());
+    VerticalParadox<> paradox(board->renderer);
+    const double start = samples[0].truth;
+    // The ring starts from the first sample, jitter and all.
+    const double measured = atan2((double) samples[0].ay, (double) samples[0].ax) * 180 / M_PI;
+    const double first = start + remainder(measured - start, 360);
+    const int lowStart = trueIndex(first - TOLERANCE), highStart = trueIndex(first + TOLERANCE);
+    Bitboard perimeter = 0;
+    for (int i = 0; i < BoardRing::LENGTH; i++) perimeter |= BoardRing::ringBit(i);
+    for (size_t i = 0; i < samples.size(); i++) {
+        paradox.tick(frameOf(samples[i]));
+        paradox.render();
+        const Bitboard frame = board->renderer.getFrame();
+        if (frame & ~perimeter) return fail("vertical", "lights only the perimeter", i, "frame %07x", frame);
+        if (!samples[i].check) continue;
+        const int step = paradox.getStep();
+        const int low = trueIndex(samples[i].truth - TOLERANCE) - highStart;
+        const int high = trueIndex(samples[i].truth + TOLERANCE) - lowStart;
+        if (step < low || step > high) {
+            return fail("vertical", "follows the true roll", i, "step %d, %.1f degrees from the start should give %d to %d",
+                        step, samples[i].truth - start, low, high);
+        }
+        bool drawn = false;
+        const int lowInitial = trueIndex(first - TOLERANCE), highInitial = trueIndex(first + TOLERANCE);
+        for (int initial = lowInitial; initial <= highInitial && !drawn; initial++) {
+            drawn = walkRing(((initial % BoardRing::LENGTH) + BoardRing::LENGTH) % BoardRing::LENGTH, step) == frame;
+        }
+        if (!drawn) return fail("vertical", "draws the ring it counted", i, "step %d drew %07x", step, frame);
+    }
+    return Failure();
+}
+
+static std::vector<Failure> check(Plan const& plan) {
+    const std::vector<Sample> samples = render(plan);
+    std::vector<Failure> failures;
+    if (samples.empty()) return failures;
+    if (plan.standing) {
+        const Failure f = checkVertical(samples);
+        if (f.failed()) failures.push_back(f);
+    } else {
+        Failure f = checkTracker(samples);
+        if (f.failed()) failures.push_back(f);
+        f = checkHorizontal(samples);
+        if (f.failed()) failures.push_back(f);
+        if (livePlan(samples)) {
+            f = checkParadox(samples);
+            if (f.failed()) failures.push_back(f);
+        }
+    }
+    return failures;
+}
+
+static bool reproduces(Plan const& plan, Failure const& target) {
+    const std::vector<Failure> failures = check(plan);
+    for (size_t i = 0; i < failures.size(); i++) {
+        if (failures[i].subject == target.subject && failures[i].property == target.property) return true;
+    }
+    return false;
+}
+
+/*
+ * Shrinks a failing plan while it still breaks the same property: drops segments and spikes,
+ * takes away the noise, and halves turns and holds, until none of that helps.
+ */
+static Plan minimise(Plan plan, Failure const& target) {
+    bool shrunk = true;
+    while (shrunk) {
+        shrunk = false;
+        for (size_t i = 0; i < plan.segments.size() && plan.segments.size() > 1; i++) {
+            Plan candidate = plan;
+            candidate.segments.erase(candidate.segments.begin() + i);
+            if (reproduces(candidate, target)) {
+                plan = candidate;
+                shrunk = true;
+                i--;
+            }
+        }
+        for (size_t i = 0; i < plan.spikes.size(); i++) {
+            Plan candidate = plan;
+            candidate.spikes.erase(candidate.spikes.begin() + i);
+            if (reproduces(candidate, target)) {
+                plan = candidate;
+                shrunk = true;
+                i--;
+            }
+        }
+        if (plan.jitter > 0 || plan.accelJitter > 0) {
+            Plan candidate = plan;
+            candidate.jitter = 0;
+            candidate.accelJitter = 0;
+            if (reproduces(candidate, target)) {
+                plan = candidate;
+                shrunk = true;
+            }
+        }
+        for (size_t i = 0; i < plan.segments.size(); i++) {
+            Plan candidate = plan;
+            Segment &s = candidate.segments[i];
+            if (s.kind == Segment::TURN && fabs(s.degrees) > 10) s.degrees /= 2;
+            else if (s.kind == Segment::HOLD && s.ms > 100) s.ms /= 2;
+            else if (s.kind != Segment::TURN && s.kind != Segment::HOLD && s.ms >= 600) s.ms /= 2; // An edge shorter than 300 ms may not reset
+            else continue;
+            if (reproduces(candidate, target)) {
+                plan = candidate;
+                shrunk = true;
+            }
+        }
+    }
+    return plan;
+}
+
+// MARK: Scripts
+
+static void describe(Plan const& plan, FILE *out) {
+    fprintf(out, "# seed %llu, %s from %.1f degrees, jitter %.1f degrees and %d mg\n", (unsigned long long) plan.seed,
+            plan.standing ? "standing" : "flat", plan.start, plan.jitter, plan.accelJitter);
+    for (size_t i = 0; i < plan.segments.size(); i++) {
+        const Segment &s = plan.segments[i];
+        if (s.kind == Segment::HOLD) fprintf(out, "#   hold %lu ms\n", s.ms);
+        if (s.kind == Segment::TURN) fprintf(out, "#   turn %+.1f degrees at %.0f degrees/s\n", s.degrees, s.rate);
+        if (s.kind == Segment::EDGE) fprintf(out, "#   tilt to edge %d for %lu ms\n", s.direction, s.ms);
+        if (s.kind == Segment::STAND) fprintf(out, "#   stand on edge %d for %lu ms\n", s.direction, s.ms);
+    }
+    for (size_t i = 0; i < plan.spikes.size(); i++) {
+        fprintf(out, "#   spike of %+d on %s at sample %zu\n", plan.spikes[i].amount,
+                plan.spikes[i].axis == 3 ? "the heading" : plan.spikes[i].axis == 0 ? "x" : plan.spikes[i].axis == 1 ? "y" : "z",
+                plan.spikes[i].at);
+    }
+}
+
+static void writeScript(const char *path, Plan const& plan, Failure const& failure) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return;
+    }
+    fprintf(f, "# time_ms ax ay az heading buttons truth edge tolerance check\n");
+    fprintf(f, "# %s: %s, at sample %zu: %s\n", failure.subject.c_str(), failure.property.c_str(), failure.at,
+            failure.detail.c_str());
+    fprintf(f, "# kind %s\n", plan.standing ? "standing" : "flat");
+    describe(plan, f);
+    const std::vector<Sample> samples = render(plan);
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample &s = samples[i];
+        fprintf(f, "%lu %d %d %d %d - %.3f %d %.0f %d\n", s.time, s.ax, s.ay, s.az, s.heading, s.truth, s.edge,
+                s.tolerance, s.check);
+    }
+    fclose(f);
+}
+
+static int replayScript(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 2;
+    }
+    std::vector<Sample> samples;
+    bool standing = false;
+    char line[256], buttons[8];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "# kind standing", 15) == 0) standing = true;
+        if (line[0] == '#') continue;
+        Sample s;
+        int edge, check;
+        if (sscanf(line, "%lu %d %d %d %d %7s %lf %d %lf %d", &s.time, &s.ax, &s.ay, &s.az, &s.heading, buttons,
+                   &s.truth, &edge, &s.tolerance, &check) != 10) continue;
+        s.edge = edge != 0;
+        s.check = check != 0;
+        samples.push_back(s);
+    }
+    fclose(f);
+    if (samples.empty()) {
+        fprintf(stderr, "%s has no samples with a truth column\n", path);
+        return 2;
+    }
+    std::vector<Failure> failures;
+    if (standing) {
+        failures.push_back(checkVertical(samples));
+    } else {
+        failures.push_back(checkTracker(samples));
+        failures.push_back(checkHorizontal(samples));
+        if (livePlan(samples)) failures.push_back(checkParadox(samples));
+    }
+    int failed = 0;
+    for (size_t i = 0; i < failures.size(); i++) {
+        if (!failures[i].failed()) continue;
+        failed++;
+        printf("%s: %s, at %lu ms: %s\n", failures[i].subject.c_str(), failures[i].property.c_str(),
+               samples[failures[i].at].time, failures[i].detail.c_str());
+    }
+    if (failed == 0) printf("%s: %zu samples, every property holds\n", path, samples.size());
+    return failed > 0 ? 1 : 0;
+}
+
+// MARK: Circular
+
+static int checkCircular() {
+    int failures = 0;
+    for (int radix = 2; radix <= 40; radix++) {
+        for (int a = 0; a < radix; a++) {
+            if (Circular::compare(a, a, radix) != NO_ROTATION) failures++;
+            for (int b = 0; b < radix; b++) {
+                const CircularDirection ab = Circular::compare(a, b, radix), ba = Circular::compare(b, a, radix);
+                const bool half = radix % 2 == 0 && Math::mod(b - a, radix) == radix / 2;
+                if (a != b && (ab == INDETERMINATE) != half) failures++;
+                if (a != b && !half && ab != -ba) failures++;
+                if (Circular::compare(a + radix, b - radix, radix) != ab) failures++;
+                for (int c = 0; c < radix; c++) {
+                    const CircularDirection abc = Circular::flow(a, b, c, radix), cba = Circular::flow(c, b, a, radix);
+                    if (abc == CLOCKWISE && cba != COUNTERCLOCKWISE) failures++;
+                    if (abc == INDETERMINATE && cba != INDETERMINATE) failures++;
+                    if (Circular::flow(a - radix, b, c + 2 * radix, radix) != abc) failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// MARK: Runner
+
+struct Found {
+    Failure failure;
+    uint64_t seed;
+    unsigned long count = 0;
+};
+
+int main(int argc, char **argv) {
+    unsigned long trajectories = 100000;
+    unsigned threads = 0;
+    uint64_t seed = 1;
+    const char *directory = ".";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0) return replayScript(argv[i + 1]);
+        if (strcmp(argv[i], "-n") == 0) trajectories = strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "-j") == 0) threads = (unsigned) atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0) seed = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "-o") == 0) directory = argv[i + 1];
+    }
+    if (trajectories == 0) {
+        fprintf(stderr, "usage: %s [-n trajectories] [-j threads] [-s seed] [-o directory] | -r script\n", argv[0]);
+        return 2;
+    }
+
+    const int circular = checkCircular();
+    printf("Circular: %d of the compare and flow properties broken for radices 2 to 40\n", circular);
+
+    const std::vector<Plan> fixed = regressions();
+    int regressed = 0;
+    for (size_t i = 0; i < fixed.size(); i++) {
+        const std::vector<Failure> failures = check(fixed[i]);
+        for (size_t k = 0; k < failures.size(); k++) {
+            regressed++;
+            printf("regression %zu, %s: %s, at sample %zu: %s\n", i + 1, failures[k].subject.c_str(),
+                   failures[k].property.c_str(), failures[k].at, failures[k].detail.c_str());
+        }
+    }
+    printf("regressions: %d of %zu fixed trajectories broken\n", regressed, fixed.size());
+
+    // The lowest failing seed of each property, and how many trajectories broke it.
+    std::vector<Found> found;
+    std::mutex lock;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool::run(trajectories, [&](size_t job, unsigned) {
+        const Plan plan = randomPlan(seed + job);
+        const std::vector<Failure> failures = check(plan);
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < failures.size(); i++) {
+            size_t k = 0;
+            while (k < found.size() && (found[k].failure.subject != failures[i].subject
+                                        || found[k].failure.property != failures[i].property)) k++;
+            if (k == found.size()) {
+                Found f;
+                f.failure = failures[i];
+                f.seed = plan.seed;
+                found.push_back(f);
+            } else if (plan.seed < found[k].seed) {
+                found[k].failure = failures[i];
+                found[k].seed = plan.seed;
+            }
+            found[k].count++;
+        }
+    }, threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%lu trajectories from seed %llu on %u threads in %.1f s, %.0f trajectories/s\n", trajectories,
+           (unsigned long long) seed, pool::workers(threads), seconds, trajectories / seconds);
+
+    for (size_t i = 0; i < found.size(); i++) {
+        const Plan plan = minimise(randomPlan(found[i].seed), found[i].failure);
+        const std::vector<Failure> failures = check(plan);
+        Failure shown = found[i].failure;
+        for (size_t k = 0; k < failures.size(); k++) {
+            if (failures[k].subject == shown.subject && failures[k].property == shown.property) shown = failures[k];
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/fuzz-%s-%llu.txt", directory, shown.subject.c_str(),
+                 (unsigned long long) found[i].seed);
+        writeScript(path, plan, shown);
+        printf("\n%s: %s, broken by %lu trajectories\n  at sample %zu: %s\n", shown.subject.c_str(),
+               shown.property.c_str(), found[i].count, shown.at, shown.detail.c_str());
+        describe(plan, stdout);
+        printf("  written to %s\n", path);
+    }
+    if (found.empty()) printf("every property held\n");
+    return found.empty() && circular == 0 && regressed == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+/*
+ * Turns counted by RotationTracker against the three-point Circular::flow heuristic it replaces,
+ * for steady spins at several speeds and sample rates.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/rotation_report.cpp -o rotation-report && ./rotation-report
+ */
+#include <stdio.h>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#define TURNS 5
+#define SECTORS 18 // The 20 degree sectors FlowCounter counts in
+
+/*
+ * The turn counting HorizontalParadox used to do on 20 degree sectors, without clamping.
+ */
+class FlowCounter {
+    private:
+        Optional<int> prevHeading     = Optional<int>();
+        Optional<int> currHeading     = Optional<int>();
+        Optional<int> initialHeading  = Optional<int>();
+        CircularDirection currUBitDir = NO_ROTATION;
+    public:
+        int turnCount = 0;
+
+        void update(int heading) {
+            prevHeading = currHeading.isNull() ? heading : currHeading._();
+            currHeading = heading;
+            if (initialHeading.isNull()) initialHeading = currHeading;
+            if (currUBitDir != NO_ROTATION && prevHeading._() != initialHeading._()) {
+                CircularDirection flow = Circular::flow(prevHeading._(), initialHeading._(), currHeading._(), SECTORS);
+                if (flow == CLOCKWISE && currUBitDir == CLOCKWISE) turnCount++;
+                if (flow == COUNTERCLOCKWISE && currUBitDir == COUNTERCLOCKWISE) turnCount--;
+            }
+            if (initialHeading._() == currHeading._()) return;
+            CircularDirection flow = Circular::flow(prevHeading._(), initialHeading._(), currHeading._(), SECTORS);
+            if (flow == CLOCKWISE || flow == COUNTERCLOCKWISE) currUBitDir = flow;
+        }
+};
+
+int main() {
+    const int rates[] = {25, 50, 100};
+    const int speeds[] = {90, 360, 1080, 2880, 4320, 8640};
+    printf("turns counted for %d clockwise turns (flow heuristic / RotationTracker)\n", TURNS);
+    printf("%-10s", "deg/s");
+    for (int r = 0; r < 3; r++) printf(" | %3d Hz, max %5ld deg/s", rates[r], RotationTracker::maxTrackableRate(rates[r]));
+    printf("\n");
+    for (int v = 0; v < 6; v++) {
+        printf("%-10d", speeds[v]);
+        for (int r = 0; r < 3; r++) {
+            FlowCounter flow;
+            RotationTracker tracker;
+            int tracked = 0;
+            // Overshoot by 30 degrees, past the hysteresis around the start angle.
+            const long samples = ((long) TURNS * 360 + 30) * rates[r] / speeds[v] + 1;
+            for (long i = 0; i <= samples; i++) {
+                const long degrees = (7 + i * speeds[v] / rates[r]) % 360;
+                flow.update((int) degrees / 20);
+                tracker.unwrap((uint16_t) (degrees * ANGLE_FULL / 360));
+                tracked += tracker.countTurns();
+            }
+            printf(" | %11d / %-10d", flow.turnCount, tracked);
+        }
+        printf("\n");
+    }
+    return 0;
+}
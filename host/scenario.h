@@ -0,0 +1,232 @@
+#ifndef HOST_SCENARIO_H
+#define HOST_SCENARIO_H
+
+/*
+ * Synthetic labelled sessions of Question 2, and scoring of detections against their labels, for the host tools.
+ * Include after source/main.cpp.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#define SAMPLE_MS 10         // The accelerometer's period in Question 2
+#define MATCH_EARLY_MS 500   // A detection this long before its label still counts as a response to it. The turn
+                             // counter starts from wherever the board was when it switched, part way through lying down
+#define MATCH_WINDOW_MS 2000 // Any later and a detection is a false transition, and its label a missed one
+
+class Random {
+    private:
+        uint64_t state;
+    public:
+        explicit Random(uint64_t seed) : state(seed * 2654435761ULL + 1) {}
+
+        uint32_t next() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return (uint32_t) (state >> 16);
+        }
+
+        double uniform(double lo, double hi) {
+            return lo + (hi - lo) * (next() / 4294967296.0);
+        }
+
+        int between(int lo, int hi) {
+            return lo + (int) (next() % (uint32_t) (hi - lo + 1));
+        }
+
+        bool chance(double p) {
+            return uniform(0, 1) < p;
+        }
+};
+
+struct Label {
+    unsigned long time;
+    int value; // an Orientation, or a turn count
+};
+
+struct Scenario {
+    std::vector<sim::Keyframe> trace;
+    std::vector<Label> flips;
+    std::vector<Label> turns;
+    std::vector<Label> moves; // when each stand up or lie down started, with its length in ms as the value
+};
+
+/*
+ * Writes a random session into a Scenario, a sample every SAMPLE_MS.
+ * Poses are kept as the gravity vector the accelerometer reads, and the heading in degrees.
+ */
+class ScenarioBuilder {
+    private:
+        Random &random;
+        Scenario &scenario;
+        unsigned long time = 0;
+        double ax = 0, ay = 0, az = -1024;
+        double heading;
+        double baseHeading;  // the heading the turn counter started from
+        int count = 0;       // turns the board has really made since baseHeading
+        bool vertical = false;
+        unsigned long joltUntil = 0;
+        double jx = 0, jy = 0, jz = 0;
+
+        void emit() {
+            sim::Keyframe k = sim::Keyframe();
+            k.time = time;
+            k.raw = true;
+            double field[3];
+            sim::magneticField((int) ax, (int) ay, (int) az, heading, field);
+            const bool jolting = time < joltUntil;
+            k.ax = (int) lround(ax + random.uniform(-20, 20) + (jolting ? jx : 0));
+            k.ay = (int) lround(ay + random.uniform(-20, 20) + (jolting ? jy : 0));
+            k.az = (int) lround(az + random.uniform(-20, 20) + (jolting ? jz : 0));
+            k.mx = (int) lround(field[0] + random.uniform(-100, 100));
+            k.my = (int) lround(field[1] + random.uniform(-100, 100));
+            k.mz = (int) lround(field[2] + random.uniform(-100, 100));
+            scenario.trace.push_back(k);
+            time += SAMPLE_MS;
+        }
+
+        // Moves the gravity vector to <x, y, z> over ms, labelling the moment it passes 45 degrees from flat.
+        void move(double x, double y, double z, unsigned long ms) {
+            const double x0 = ax, y0 = ay, z0 = az;
+            for (unsigned long t = 0; t < ms; t += SAMPLE_MS) {
+                const double f = (double) t / ms;
+                double nx = x0 + (x - x0) * f, ny = y0 + (y - y0) * f, nz = z0 + (z - z0) * f;
+                const double norm = sqrt(nx * nx + ny * ny + nz * nz);
+                nx *= 1024 / norm; ny *= 1024 / norm; nz *= 1024 / norm;
+                const bool wasVertical = fabs(az) < 1024 * M_SQRT1_2;
+                ax = nx; ay = ny; az = nz;
+                const bool isVertical = fabs(az) < 1024 * M_SQRT1_2;
+                if (isVertical != wasVertical) {
+                    Label flip = {time, isVertical ? VERTICAL : HORIZONTAL};
+                    scenario.flips.push_back(flip);
+                }
+                emit();
+            }
+            ax = x; ay = y; az = z;
+        }
+
+        void rest(unsigned long ms) {
+            if (random.chance(0.3)) {
+                // Knocking the board: a short burst of acceleration in a random direction.
+                const double magnitude = random.uniform(300, 900);
+                const double a = random.uniform(0, 2 * M_PI), b = random.uniform(-1, 1);
+                jx = magnitude * sqrt(1 - b * b) * cos(a);
+                jy = magnitude * sqrt(1 - b * b) * sin(a);
+                jz = magnitude * b;
+                joltUntil = time + random.between(ms / 4, ms / 2) + random.between(40, 150);
+            }
+            for (unsigned long t = 0; t < ms; t += SAMPLE_MS) emit();
+        }
+
+        void spin() {
+            // Stay within the 0 to 9 turns the display can show.
+            int n = 0;
+            while (n == 0 || count + n < 0 || count + n > 9) n = random.between(-3, 3);
+            const double overshoot = random.uniform(25, 60);
+            const double target = baseHeading + (n > 0 ? (count + n) * 360 + overshoot : (count + n + 1) * 360 - overshoot);
+            const double rate = random.uniform(180, 540) / 1000 * SAMPLE_MS; // degrees per sample
+            const double tiltX = random.uniform(-150, 150), tiltY = random.uniform(-150, 150);
+            move(tiltX, tiltY, -sqrt(1024.0 * 1024 - tiltX * tiltX - tiltY * tiltY), 200);
+            while (fabs(target - heading) > rate) {
+                heading += target > heading ? rate : -rate;
+                const double rel = heading - baseHeading;
+                if (rel > (count + 1) * 360) {
+                    count++;
+                    Label turn = {time, count};
+                    scenario.turns.push_back(turn);
+                } else if (rel < count * 360) {
+                    count--;
+                    Label turn = {time, count};
+                    scenario.turns.push_back(turn);
+                }
+                emit();
+            }
+            rest(1000);
+        }
+
+        void standUp() {
+            const double roll = random.uniform(0, 2 * M_PI);
+            const Label standing = {time, random.between(300, 800)};
+            scenario.moves.push_back(standing);
+            move(-1024 * cos(roll), -1024 * sin(roll), 0, standing.value);
+            vertical = true;
+            rest(1200);
+        }
+
+        void roll() {
+            const double roll = atan2(-ay, -ax) + random.uniform(-M_PI, M_PI);
+            move(-1024 * cos(roll), -1024 * sin(roll), 0, random.between(500, 2000));
+            rest(500);
+        }
+
+        void lieDown() {
+            const Label lying = {time, random.between(300, 800)};
+            scenario.moves.push_back(lying);
+            move(0, 0, -1024, lying.value);
+            vertical = false;
+            // The turn counter starts again from wherever the board lies down.
+            baseHeading = heading;
+            count = 0;
+            rest(1200);
+        }
+    public:
+        ScenarioBuilder(Random &random, Scenario &scenario) : random(random), scenario(scenario) {
+            heading = baseHeading = random.uniform(0, 360);
+        }
+
+        void build(int steps) {
+            rest(1500);
+            for (int i = 0; i < steps; i++) {
+                const double r = random.uniform(0, 1);
+                if (r < 0.2) {
+                    rest(random.between(500, 2000));
+                } else if (!vertical) {
+                    if (r < 0.65) spin(); else standUp();
+                } else {
+                    if (r < 0.6) roll(); else lieDown();
+                }
+            }
+            rest(1500);
+        }
+};
+
+struct Score {
+    double latency = 0;      // summed over matched labels, in ms
+    unsigned long matched = 0;
+    unsigned long falses = 0; // detections with no label, and labels with no detection
+
+    void add(Score const& other) {
+        latency += other.latency;
+        matched += other.matched;
+        falses += other.falses;
+    }
+
+    double meanLatency() const {
+        return matched ? latency / matched : 0;
+    }
+};
+
+// Pairs each label with the first unused detection of the same value that follows it closely enough.
+inline void match(std::vector<Label> const& labels, std::vector<Label> const& detections, Score &score) {
+    std::vector<bool> used(detections.size(), false);
+    for (size_t i = 0; i < labels.size(); i++) {
+        const Label &label = labels[i];
+        bool found = false;
+        for (size_t j = 0; j < detections.size() && !found; j++) {
+            const Label &d = detections[j];
+            if (used[j] || d.value != label.value) continue;
+            if (d.time + MATCH_EARLY_MS < label.time || d.time > label.time + MATCH_WINDOW_MS) continue;
+            used[j] = true;
+            found = true;
+            score.latency += d.time > label.time ? d.time - label.time : 0;
+            score.matched++;
+        }
+        if (!found) score.falses++;
+    }
+    for (size_t j = 0; j < detections.size(); j++) {
+        if (!used[j]) score.falses++;
+    }
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Replays a recorded trace through Question 2's logic on recorded time, without the simulator's clock,
+ * so the same trace always produces the same frames. Compare the digest before and after a change to
+ * the filters or the rotation logic to check that it behaves identically on real input.
+ *
+ *   g++ -std=c++11 -O2 -Ihost host/trace_replay.cpp -o trace-replay
+ *   ./trace-replay host/traces/paradox.trace [--frames]
+ */
+#include <stdio.h>
+#include <string.h>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "replay.h"
+
+static void printFrame(uint32_t time, Bitboard frame) {
+    printf("%lu ms\n", (unsigned long) time);
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        for (int x = 0; x < BOARD_WIDTH; x++) putchar(frame & pixelBit(x, y) ? '#' : '.');
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace [--frames]\n", argv[0]);
+        return 2;
+    }
+    const bool frames = argc > 2 && strcmp(argv[2], "--frames") == 0;
+
+    std::vector<sim::Keyframe> trace;
+    unsigned long skipped = 0;
+    if (!sim::readTrace(argv[1], trace, &skipped) || trace.empty()) {
+        fprintf(stderr, "%s is not a trace\n", argv[1]);
+        return 1;
+    }
+
+    ParadoxThatDrivesUsAll<> paradox(uBit);
+    const ReplayOutcome outcome = replay(trace, paradox, [frames](uint32_t time, Bitboard frame) {
+        if (frames) printFrame(time, frame);
+    });
+    printf("%zu records over %lu ms, %lu corrupt bytes skipped\n", trace.size(), outcome.simulatedMs, skipped);
+    printf("%lu frame changes, digest %016llx\n", outcome.frameChanges, (unsigned long long) outcome.digest);
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Sweeps Question 2's Config over a grid of values, replaying synthetic labelled traces on every core,
+ * and reports the Pareto front of response latency against false transitions.
+ *
+ * Each trace is a random session of spins, stand ups, rolls and lie downs, with hand tremor and the odd jolt.
+ * It is labelled with when the board really changed orientation (when it passed 45 degrees), and when
+ * each whole turn was really completed. Every configuration is its own instantiation of the firmware's
+ * classes, so the values are folded in just as they would be on the board.
+ *
+ *   g++ -std=c++11 -O2 -pthread -Ihost host/tuner.cpp -o tuner
+ *   ./tuner [-t traces] [-j threads] [-s seed]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#define main firmware_main
+#include "../source/main.cpp"
+#undef main
+
+#include "pool.h"
+#include "scenario.h"
+
+template <long IndexBuffer, long TiltSens, long TiltBuffer, long GravitySmoothing, long FieldSmoothing,
+          long OrientationSmoothing, long VerticalTilt, long HorizontalTilt, long Gravity>
+struct TunedConfig {
+    static constexpr unsigned long INDEX_BUFFER       = IndexBuffer;
+    static constexpr int TILT_SENS                    = TiltSens;
+    static constexpr unsigned long TILT_BUFFER        = TiltBuffer;
+    static constexpr int GRAVITY_SMOOTHING            = GravitySmoothing;
+    static constexpr int FIELD_SMOOTHING              = FieldSmoothing;
+    static constexpr int ORIENTATION_SMOOTHING        = OrientationSmoothing;
+    static constexpr int VERTICAL_TILT                = VerticalTilt;
+    static constexpr int HORIZONTAL_TILT              = HorizontalTilt;
+    static constexpr int GRAVITY                      = Gravity;
+};
+
+#define PARAMETERS 9
+static const char *const NAMES[PARAMETERS] = {
+    "INDEX_BUFFER", "TILT_SENS", "TILT_BUFFER", "GRAVITY_SMOOTHING", "FIELD_SMOOTHING",
+    "ORIENTATION_SMOOTHING", "VERTICAL_TILT", "HORIZONTAL_TILT", "GRAVITY"
+};
+
+// The values swept for each parameter, in the order TunedConfig takes them.
+template <long... Vs>
+struct Axis {};
+
+// Every configuration is compiled separately, so the grid is kept to what builds in under a minute.
+typedef Axis<150> IndexBuffers; // The ring has no labels, so it is not tuned
+typedef Axis<250, 300> TiltSensitivities;
+typedef Axis<50, 150, 300> TiltBuffers;
+typedef Axis<3> GravitySmoothings;
+typedef Axis<1> FieldSmoothings;
+typedef Axis<2, 3> OrientationSmoothings;
+typedef Axis<50, 55, 60> VerticalTilts;
+typedef Axis<30, 35> HorizontalTilts;
+typedef Axis<1250, 1500> Gravities;
+
+/*
+ * Calls f.visit<Make<...> >() for every combination of the values on each Axis.
+ * The first Axis holds the values chosen so far.
+ */
+template <template <long...> class Make, class Chosen, class... Axes>
+struct Sweep;
+
+template <template <long...> class Make, long... Cs>
+struct Sweep<Make, Axis<Cs...> > {
+    template <class F>
+    static void each(F &f) {
+        f.template visit<Make<Cs...> >();
+    }
+};
+
+template <template <long...> class Make, long... Cs, long... Vs, class... Rest>
+struct Sweep<Make, Axis<Cs...>, Axis<Vs...>, Rest...> {
+    template <class F>
+    static void each(F &f) {
+        int expand[] = {0, (Sweep<Make, Axis<Cs..., Vs>, Rest...>::each(f), 0)...};
+        (void) expand;
+    }
+};
+
+/*
+ * Tilting the board to the edge of the display resets the turn count by design,
+ * so a reset while it stands up or lies down is not a false transition.
+ */
+static bool duringMove(Scenario const& scenario, Label const& turn) {
+    if (turn.value != 0) return false;
+    for (size_t i = 0; i < scenario.moves.size(); i++) {
+        const Label &m = scenario.moves[i];
+        if (turn.time >= m.time && turn.time <= m.time + m.value + MATCH_WINDOW_MS) return true;
+    }
+    return false;
+}
+
+template <class C>
+Score evaluate(Scenario const& scenario) {
+    sim::Simulator simulator;
+    MicroBit uBit(simulator);
+    std::unique_ptr<ParadoxThatDrivesUsAll<C> > device(new ParadoxThatDrivesUsAll<C>(uBit));
+    std::vector<Label> flips, turns;
+    int lastTurns = 0;
+    for (size_t i = 0; i < scenario.trace.size(); i++) {
+        const sim::Keyframe &k = scenario.trace[i];
+        SensorFrame frame = {k.time, k.ax, k.ay, k.az, k.mx, k.my, k.mz};
+        const Orientation before = device->getOrientation();
+        device->replay(frame);
+        const Orientation after = device->getOrientation();
+        if (after != before) {
+            Label flip = {k.time, after};
+            flips.push_back(flip);
+        } else if (after == HORIZONTAL && device->getTurns() != lastTurns) {
+            Label turn = {k.time, device->getTurns()};
+            if (!duringMove(scenario, turn)) turns.push_back(turn);
+        }
+        lastTurns = device->getTurns();
+    }
+    Score score;
+    match(scenario.flips, flips, score);
+    match(scenario.turns, turns, score);
+    return score;
+}
+
+struct Variant {
+    long values[PARAMETERS];
+    Score (*evaluate)(Scenario const&);
+    Score score;
+};
+
+struct Collect {
+    std::vector<Variant> &variants;
+
+    template <class C>
+    void visit() {
+        Variant v = {{(long) C::INDEX_BUFFER, C::TILT_SENS, (long) C::TILT_BUFFER, C::GRAVITY_SMOOTHING,
+                      C::FIELD_SMOOTHING, C::ORIENTATION_SMOOTHING, C::VERTICAL_TILT, C::HORIZONTAL_TILT,
+                      C::GRAVITY}, &evaluate<C>, Score()};
+        variants.push_back(v);
+    }
+};
+
+static bool isDefault(Variant const& v) {
+    const long defaults[PARAMETERS] = {(long) Config::INDEX_BUFFER, Config::TILT_SENS, (long) Config::TILT_BUFFER,
+                                       Config::GRAVITY_SMOOTHING, Config::FIELD_SMOOTHING, Config::ORIENTATION_SMOOTHING,
+                                       Config::VERTICAL_TILT, Config::HORIZONTAL_TILT, Config::GRAVITY};
+    return memcmp(v.values, defaults, sizeof(defaults)) == 0;
+}
+
+static void printVariant(Variant const& v) {
+    printf("%8.1f %6lu", v.score.meanLatency(), v.score.falses);
+    for (int p = 0; p < PARAMETERS; p++) printf(" %*ld", (int) strlen(NAMES[p]), v.values[p]);
+    printf("%s\n", isDefault(v) ? "  (Config)" : "");
+}
+
+int main(int argc, char **argv) {
+    int traces = 64;
+    unsigned threads = 0;
+    uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-t") == 0) traces = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-j") == 0) threads = (unsigned) atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0) seed = strtoull(argv[i + 1], NULL, 10);
+    }
+    if (traces <= 0) {
+        fprintf(stderr, "usage: %s [-t traces] [-j threads] [-s seed]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Scenario> scenarios(traces);
+    unsigned long samples = 0, flips = 0, turns = 0;
+    for (int i = 0; i < traces; i++) {
+        Random random(seed + i);
+        ScenarioBuilder(random, scenarios[i]).build(12);
+        samples += scenarios[i].trace.size();
+        flips += scenarios[i].flips.size();
+        turns += scenarios[i].turns.size();
+    }
+
+    std::vector<Variant> variants;
+    Collect collect = {variants};
+    Sweep<TunedConfig, Axis<>, IndexBuffers, TiltSensitivities, TiltBuffers, GravitySmoothings, FieldSmoothings,
+          OrientationSmoothings, VerticalTilts, HorizontalTilts, Gravities>::each(collect);
+
+    const size_t jobs = variants.size() * scenarios.size();
+    std::vector<Score> scores(jobs);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool::run(jobs, [&](size_t job, unsigned) {
+        scores[job] = variants[job / scenarios.size()].evaluate(scenarios[job % scenarios.size()]);
+    }, threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t job = 0; job < jobs; job++) variants[job / scenarios.size()].score.add(scores[job]);
+
+    printf("%zu configurations x %d traces (%lu s of samples, %lu orientation changes, %lu turns) on %u threads\n",
+           variants.size(), traces, samples * SAMPLE_MS / 1000, flips, turns, pool::workers(threads));
+    printf("%.2f s, %.0f simulated ticks/s\n\n", seconds, variants.size() * samples / seconds);
+
+    // The Pareto front: sorted by latency, each has fewer false transitions than everything faster.
+    std::vector<Variant> sorted(variants);
+    std::sort(sorted.begin(), sorted.end(), [](Variant const& a, Variant const& b) {
+        if (a.score.meanLatency() != b.score.meanLatency()) return a.score.meanLatency() < b.score.meanLatency();
+        return a.score.falses < b.score.falses;
+    });
+    printf("%8s %6s", "latency", "false");
+    for (int p = 0; p < PARAMETERS; p++) printf(" %s", NAMES[p]);
+    printf("\n");
+    unsigned long best = (unsigned long) -1;
+    bool defaultOnFront = false;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        if (sorted[i].score.falses >= best) continue;
+        best = sorted[i].score.falses;
+        defaultOnFront = defaultOnFront || isDefault(sorted[i]);
+        printVariant(sorted[i]);
+    }
+    if (!defaultOnFront) {
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (!isDefault(sorted[i])) continue;
+            printf("\nThe current Config is not on the front:\n");
+            printVariant(sorted[i]);
+        }
+    }
+    return 0;
+}
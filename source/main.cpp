@@ -1,39 +1,249 @@
 #include "MicroBit.h"
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include <utility>
 
-MicroBit uBit;
+// MARK 0: Helper classes
 /*
- * Initialization of MicroBitImage seems to be a little broken,
- * so we will settle with reusing one image instead.
+ * Hot path instrumentation. Building with -DPROFILE records how long each stage of a tick takes
+ * into log2 histograms, next to counters of ticks, sensor reads and display commits.
+ * Recording is a few adds into fixed arrays, and the report is only formatted when dumped.
+ * Without PROFILE, the PROFILE_ macros compile to nothing.
  */
-MicroBitImage im(5, 5);
+enum ProfileStage { STAGE_TICK, STAGE_ORIENTER, STAGE_FILTER, STAGE_ANGLE, STAGE_ACCELEROMETER, STAGE_COMPASS,
+                    STAGE_HEADING, STAGE_COMMIT, STAGE_COUNT };
+enum ProfileCounter { COUNT_TICKS, COUNT_SENSOR_READS, COUNT_COMMITS, COUNTER_COUNT };
+#define HISTOGRAM_BINS 16 // Bin i counts durations under 2^i us, and the last bin everything longer
+#ifdef PROFILE
+class Profiler {
+    private:
+        uint32_t histograms[STAGE_COUNT][HISTOGRAM_BINS];
+        uint32_t counters[COUNTER_COUNT];
+        bool framed;
+        unsigned long firstFrameMs;
+        bool inputPending;
+        unsigned long inputMs;
+        uint32_t inputs;
+        uint32_t inputLatencyMs;
+        uint32_t maxInputLatencyMs;
+
+        static const char *stageName(int stage) {
+            static const char *const NAMES[STAGE_COUNT] = {
+                "tick", "orienter", "filter", "angle", "accelerometer", "compass", "heading", "commit"
+            };
+            return NAMES[stage];
+        }
+    public:
+        void record(ProfileStage stage, uint32_t us) {
+            int bin = 0;
+            while (us && bin < HISTOGRAM_BINS - 1) {
+                us >>= 1;
+                bin++;
+            }
+            histograms[stage][bin]++;
+        }
 
-// MARK 0: Helper classes
-template <class S>
-class ButtonWrapper {
+        void count(ProfileCounter counter, uint32_t n) {
+            counters[counter] += n;
+        }
+
+        /*
+         * Notes when the first frame reached the display, which is how long the user waits after power up,
+         * and how long the frame took to answer any button input before it.
+         */
+        void frame(MicroBit &uBit) {
+            if (inputPending) {
+                const uint32_t latency = uBit.systemTime() - inputMs;
+                inputs++;
+                inputLatencyMs += latency;
+                if (latency > maxInputLatencyMs) maxInputLatencyMs = latency;
+                inputPending = false;
+            }
+            if (framed) return;
+            framed = true;
+            firstFrameMs = uBit.systemTime();
+        }
+
+        // A button gesture was handled, for the button edge (or hold) at ms. The next frame answers it.
+        void input(unsigned long ms) {
+            if (inputPending) return;
+            inputPending = true;
+            inputMs = ms;
+        }
+
+        // A render left the frame as it was, so the input before it changed nothing on the display.
+        void unchanged() {
+            inputPending = false;
+        }
+
+        // Writes the histograms and rates since boot to serial, as "bin upper bound in us:count" pairs.
+        void dump(MicroBit &uBit) {
+            const unsigned long ms = uBit.systemTime() > 0 ? uBit.systemTime() : 1;
+            const uint32_t ticks = counters[COUNT_TICKS] > 0 ? counters[COUNT_TICKS] : 1;
+            const uint32_t readsPerTick = counters[COUNT_SENSOR_READS] * 100 / ticks;
+            uBit.serial.printf("profile: %lu ms, %lu ticks/s, %lu.%02lu sensor reads/tick, %lu commits/s\r\n", ms,
+                               (unsigned long) (counters[COUNT_TICKS] * 1000ULL / ms),
+                               (unsigned long) (readsPerTick / 100), (unsigned long) (readsPerTick % 100),
+                               (unsigned long) (counters[COUNT_COMMITS] * 1000ULL / ms));
+            if (framed) uBit.serial.printf("first frame at %lu ms\r\n", firstFrameMs);
+            if (inputs) {
+                uBit.serial.printf("%lu inputs shown %lu ms after the button on average, %lu ms at worst\r\n",
+                                   (unsigned long) inputs, (unsigned long) (inputLatencyMs / inputs),
+                                   (unsigned long) maxInputLatencyMs);
+            }
+            for (int stage = 0; stage < STAGE_COUNT; stage++) {
+                uBit.serial.printf("%-13s", stageName(stage));
+                for (int bin = 0; bin < HISTOGRAM_BINS; bin++) {
+                    if (histograms[stage][bin]) uBit.serial.printf(" <%lu:%lu", 1UL << bin, (unsigned long) histograms[stage][bin]);
+                }
+                uBit.serial.printf("\r\n");
+            }
+        }
+} profiler;
+
+// Records the time from its construction to the end of the enclosing scope against a stage.
+class ProfileScope {
     private:
-        unsigned long lastPressed;
-        unsigned long repeatDelay;
+        ProfileStage stage;
+        uint32_t start;
     public:
-        MicroBitButton *uButton;
+        ProfileScope(ProfileStage stage) {
+            this->stage = stage;
+            start = (uint32_t) system_timer_current_time_us();
+        }
 
-        ButtonWrapper(MicroBitButton *uButton, unsigned long repeatDelay) {
-            this->uButton = uButton;
-            this->repeatDelay = repeatDelay;
-            lastPressed = uBit.systemTime();
+        ~ProfileScope() {
+            profiler.record(stage, (uint32_t) system_timer_current_time_us() - start);
         }
+};
+
+#define PROFILE_SCOPE(stage) ProfileScope profileScope(stage)
+#define PROFILE_COUNT(counter, n) profiler.count(counter, n)
+#define PROFILE_FRAME(uBit) profiler.frame(uBit)
+#define PROFILE_INPUT(ms) profiler.input(ms)
+#define PROFILE_UNCHANGED() profiler.unchanged()
+#else
+#define PROFILE_SCOPE(stage)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_FRAME(uBit)
+#define PROFILE_INPUT(ms)
+#define PROFILE_UNCHANGED()
+#endif
+
+/*
+ * A 5x5 frame packed into the low 25 bits of a uint32_t, with pixel (x, y) at bit (y * 5 + x).
+ * Frames are composed by OR-ing masks together, and only expanded into im when committed.
+ */
+#define BOARD_WIDTH 5
+#define BOARD_HEIGHT 5
+typedef uint32_t Bitboard;
 
-        void onPress(void (S::*op)(), S *s) {
-            if (uButton->isPressed() && uBit.systemTime() - lastPressed > repeatDelay) {
-                lastPressed = uBit.systemTime();
-                (*s.*op)();
+constexpr Bitboard pixelBit(int x, int y) {
+    return (Bitboard) 1 << (y * BOARD_WIDTH + x);
+}
+
+// Bits of one glyph row, where 0x10 is the leftmost column.
+constexpr Bitboard rowBits(int row, int y, int x = 0) {
+    return x == BOARD_WIDTH ? 0 : ((row & (0x10 >> x)) ? pixelBit(x, y) : 0) | rowBits(row, y, x + 1);
+}
+
+constexpr Bitboard glyph(int r0, int r1, int r2, int r3, int r4) {
+    return rowBits(r0, 0) | rowBits(r1, 1) | rowBits(r2, 2) | rowBits(r3, 3) | rowBits(r4, 4);
+}
+
+static const Bitboard DIGITS[10] = {
+    glyph(0x0C, 0x12, 0x12, 0x12, 0x0C), glyph(0x04, 0x0C, 0x04, 0x04, 0x0E),
+    glyph(0x1C, 0x02, 0x0C, 0x10, 0x1E), glyph(0x1E, 0x02, 0x04, 0x12, 0x0C),
+    glyph(0x06, 0x0A, 0x12, 0x1F, 0x02), glyph(0x1F, 0x10, 0x1E, 0x01, 0x1E),
+    glyph(0x02, 0x04, 0x0E, 0x11, 0x0E), glyph(0x1F, 0x02, 0x04, 0x08, 0x10),
+    glyph(0x0E, 0x11, 0x0E, 0x11, 0x0E), glyph(0x0E, 0x11, 0x0E, 0x04, 0x08)
+};
+
+/*
+ * Compile-time integer sequences, used to generate lookup tables from constexpr functions.
+ */
+template <int... Is>
+struct Indices {};
+
+template <class A, class B>
+struct JoinIndices;
+
+template <int... As, int... Bs>
+struct JoinIndices<Indices<As...>, Indices<Bs...> > {
+    typedef Indices<As..., (int) sizeof...(As) + Bs...> type;
+};
+
+// Built by halves, so that a table of N entries only nests log2(N) templates deep.
+template <int N>
+struct MakeIndices {
+    typedef typename JoinIndices<typename MakeIndices<N / 2>::type, typename MakeIndices<N - N / 2>::type>::type type;
+};
+
+template <>
+struct MakeIndices<0> {
+    typedef Indices<> type;
+};
+
+template <>
+struct MakeIndices<1> {
+    typedef Indices<0> type;
+};
+
+// sin(x) by its Taylor series, for x from 0 to PI / 2. Only ever evaluated by the compiler.
+constexpr double taylorSin(double x) {
+    return x * (1 - x * x / 6 * (1 - x * x / 20 * (1 - x * x / 42 * (1 - x * x / 72))));
+}
+
+/*
+ * Pushes frames to the display only when they differ from the last frame committed,
+ * so that redrawing an unchanged frame every tick never reaches the LED driver.
+ */
+class Renderer {
+    private:
+        MicroBit &uBit;
+        /*
+         * Initialization of MicroBitImage seems to be a little broken,
+         * so we will settle with reusing one image instead.
+         */
+        MicroBitImage im = MicroBitImage(5, 5);
+        Bitboard lastFrame = 0;
+        bool hasFrame = false;
+        unsigned long submitted = 0;
+        unsigned long skipped = 0;
+    public:
+        Renderer(MicroBit &uBit) : uBit(uBit) {}
+
+        void commit(Bitboard frame) {
+            if (hasFrame && frame == lastFrame) {
+                PROFILE_UNCHANGED();
+                skipped++;
+                return;
             }
-            /*
-             * If the key is lifted before the key repeat delay is over, then reset the key event
-             * by shifting the lastPressed back by KEY_REPEAT_DELAY
-             */
-            if (!uButton->isPressed() && uBit.systemTime() - lastPressed < repeatDelay) {
-                lastPressed = uBit.systemTime() - repeatDelay;
+            PROFILE_SCOPE(STAGE_COMMIT);
+            PROFILE_COUNT(COUNT_COMMITS, 1);
+            PROFILE_FRAME(uBit);
+            lastFrame = frame;
+            hasFrame = true;
+            submitted++;
+            for (int y = 0; y < BOARD_HEIGHT; y++) {
+                for (int x = 0; x < BOARD_WIDTH; x++) {
+                    im.setPixelValue(x, y, (frame & pixelBit(x, y)) ? 255 : 0);
+                }
             }
+            uBit.display.print(im);
+        }
+
+        Bitboard getFrame() {
+            return lastFrame;
+        }
+
+        unsigned long getSubmitted() {
+            return submitted;
+        }
+
+        unsigned long getSkipped() {
+            return skipped;
         }
 };
 
@@ -67,6 +277,7 @@ class Math {
         }
 
         /*
+         * Floating point reference for Angle::of, which replaces it on the device.
          * @return degrees from 0 to <360
          */
         static double degrees(int x, int y) {
@@ -77,6 +288,14 @@ class Math {
             const int result = x % radix;
             return result >= 0 ? result : result + radix;
         }
+
+        static int median(int a, int b, int c) {
+            if (a > b) {
+                const int t = a; a = b; b = t;
+            }
+            return c < a ? a : c > b ? b : c;
+        }
+
         static int squaredMagnitude(int x, int y) {
             return x * x + y * y;
         }
@@ -84,22 +303,120 @@ class Math {
         static int squaredMagnitude(int x, int y, int z) {
             return x * x + y * y + z * z;
         }
+
+        // floor(sqrt(x)), a bit of the result at a time.
+        static int isqrt(uint32_t x) {
+            uint32_t root = 0;
+            for (uint32_t bit = 1UL << 30; bit != 0; bit >>= 2) {
+                if (x >= root + bit) {
+                    x -= root + bit;
+                    root = (root >> 1) + bit;
+                } else {
+                    root >>= 1;
+                }
+            }
+            return (int) root;
+        }
     private:
         Math() {}
 };
 
+/*
+ * Angles in binary angle units, where a full turn is 65536 and angles wrap naturally in a uint16_t.
+ * Everything here is integer-only, so that no soft-float code is pulled in on the Cortex-M0.
+ */
+#define ANGLE_QUARTER 16384
+#define ANGLE_HALF 32768
+#define ANGLE_FULL 65536
+#define ATAN_TABLE_BITS 5
+class Angle {
+    private:
+        /*
+         * ATAN_TABLE[i] = atan(i / 32) in binary angle units, for ratios 0 to 1.
+         */
+        static int atanTable(int i) {
+            static const uint16_t ATAN_TABLE[(1 << ATAN_TABLE_BITS) + 1] = {
+                0, 326, 651, 975, 1297, 1617, 1933, 2246, 2555, 2860, 3159, 3453, 3742, 4025, 4302, 4572, 4836,
+                5094, 5344, 5589, 5826, 6058, 6282, 6500, 6712, 6917, 7117, 7310, 7498, 7679, 7856, 8026, 8192
+            };
+            return ATAN_TABLE[i];
+        }
+
+        /*
+         * atan(n / d) for 0 <= n <= d, by linear interpolation between table entries.
+         */
+        static int atanRatio(int n, int d) {
+            const int ratio = (n << 15) / d;                    // 0 to 32768
+            const int i = ratio >> (15 - ATAN_TABLE_BITS);
+            const int frac = ratio & ((1 << (15 - ATAN_TABLE_BITS)) - 1);
+            if (i == (1 << ATAN_TABLE_BITS)) return atanTable(i);
+            return atanTable(i) + (((atanTable(i + 1) - atanTable(i)) * frac) >> (15 - ATAN_TABLE_BITS));
+        }
+    public:
+        /*
+         * Integer equivalent of Math::degrees, with inputs of up to 16 bits.
+         * @return the angle of <x, y> from 0 to <65536
+         */
+        static uint16_t of(int x, int y) {
+            if (x == 0 && y == 0) return 0;
+            const int ax = Math::abs(x);
+            const int ay = Math::abs(y);
+            // Reduce to the first octant, where the ratio is at most 1, then reflect back out.
+            int angle = ay <= ax ? atanRatio(ay, ax) : ANGLE_QUARTER - atanRatio(ax, ay);
+            if (x < 0) angle = ANGLE_HALF - angle;
+            if (y < 0) angle = -angle;
+            return (uint16_t) angle;
+        }
+
+        /*
+         * Splits the circle into equal sectors, the first of which starts at 0 degrees.
+         * @return the sector that <x, y> lies in, from 0 to <sectors
+         */
+        static int sector(int x, int y, int sectors) {
+            return ((int32_t) of(x, y) * sectors) >> 16;
+        }
+
+        /*
+         * Quarter of a sine wave, interpolated and mirrored out to the full circle.
+         * @return sin(angle) with 14 fractional bits, from -16384 to 16384
+         */
+        static int sin(uint16_t angle) {
+            static const uint16_t SIN_TABLE[65] = {
+                0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897,
+                6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+                11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+                15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+                16384
+            };
+            const int quadrant = angle >> 14;
+            int q = angle & (ANGLE_QUARTER - 1);
+            if (quadrant & 1) q = ANGLE_QUARTER - q;
+            const int i = q >> 8;
+            const int value = i == 64 ? SIN_TABLE[64] : SIN_TABLE[i] + (((SIN_TABLE[i + 1] - SIN_TABLE[i]) * (q & 255)) >> 8);
+            return quadrant & 2 ? -value : value;
+        }
+
+        static int cos(uint16_t angle) {
+            return sin(angle + ANGLE_QUARTER);
+        }
+    private:
+        Angle() {}
+};
+
 enum CircularDirection { CLOCKWISE = 1, COUNTERCLOCKWISE = -1, NO_ROTATION = 0, INDETERMINATE = 2 };
 class Circular {
     public:
         /*
-         * Given a circular structure with a given radix, determine the order of a and b
+         * Given a circular structure with a given radix, determine the order of a and b.
+         * Only an even radix has points exactly half of it apart, and their order is indeterminate.
          *
          * @param radix the size of the circular structure
          */
         static CircularDirection compare(int a, int b, int radix) {
-            if (b == a) return NO_ROTATION;
-            if (Math::mod(b - a, radix) == radix / 2) return INDETERMINATE;
-            if (Math::mod(b - a, radix) < radix / 2) return CLOCKWISE;
+            const int distance = Math::mod(b - a, radix);
+            if (distance == 0) return NO_ROTATION;
+            if (2 * distance == radix) return INDETERMINATE;
+            if (2 * distance < radix) return CLOCKWISE;
             return COUNTERCLOCKWISE;
         }
 
@@ -110,7 +427,7 @@ class Circular {
          * @return the direction of flow, no flow, or indeterminate flow.
          */
         static CircularDirection flow(int a, int b, int c, int radix) {
-            if (a == b && b == c) return NO_ROTATION;
+            if (Math::mod(b - a, radix) == 0 && Math::mod(c - b, radix) == 0) return NO_ROTATION;
             if (Math::mod(b - a, radix) <= radix / 3 && Math::mod(c - b, radix) <= radix / 3) return CLOCKWISE;
             if (Math::mod(b - c, radix) <= radix / 3 && Math::mod(a - b, radix) <= radix / 3) return COUNTERCLOCKWISE;
             return INDETERMINATE;
@@ -119,6 +436,81 @@ class Circular {
         Circular() {}
 };
 
+/*
+ * Unwraps an angle that wraps every turn into a continuous angle, and counts whole turns around
+ * the angle it started at, at the full resolution of the input instead of in coarse sectors.
+ * Successive samples are told apart by the shorter way round, so the device has to turn less than
+ * half a turn between samples: see maxTrackableRate.
+ */
+#define TURN_HYSTERESIS 2048 // How far past the start angle, in binary angle units, before a turn is counted
+class RotationTracker {
+    private:
+        bool started = false;
+        uint16_t lastRaw = 0;
+        int32_t start = 0;
+        int32_t angle = 0;
+        int turns = 0;
+    public:
+        /*
+         * @param raw the wrapped angle in binary angle units
+         * @return the continuous angle, which starts at raw and keeps growing or shrinking with every turn
+         */
+        int32_t unwrap(uint16_t raw) {
+            if (!started) {
+                started = true;
+                start = raw;
+                angle = raw;
+            } else {
+                angle += (int16_t) (uint16_t) (raw - lastRaw);
+            }
+            lastRaw = raw;
+            return angle;
+        }
+
+        /*
+         * Counts turns once the angle is TURN_HYSTERESIS past a whole turn from the start angle,
+         * so that jitter around the start angle is not counted more than once.
+         * @return the number of turns gained (positive) or undone (negative) since the last call
+         */
+        int countTurns() {
+            const int before = turns;
+            while (angle - start > (int32_t) (turns + 1) * ANGLE_FULL + TURN_HYSTERESIS) turns++;
+            while (angle - start < (int32_t) turns * ANGLE_FULL - TURN_HYSTERESIS) turns--;
+            return turns - before;
+        }
+
+        int32_t getAngle() {
+            return angle;
+        }
+
+        int32_t getStart() {
+            return start;
+        }
+
+        int getTurns() {
+            return turns;
+        }
+
+        void reset() {
+            started = false;
+            turns = 0;
+        }
+
+        // Counts from the current angle again, as though it had started there.
+        void rebase() {
+            start = angle;
+            turns = 0;
+        }
+
+        /*
+         * Samples more than half a turn apart are ambiguous.
+         * @return the fastest rotation, in degrees per second, that can be tracked at a sample rate
+         */
+        static constexpr long maxTrackableRate(int sampleHz) {
+            return 180L * sampleHz;
+        }
+};
+
 struct Coord {
     int x;
     int y;
@@ -132,6 +524,219 @@ struct Coord {
     }
 };
 
+/*
+ * A snapshot of the sensors, sampled once per tick and handed to every getRaw producer.
+ * Consumers within a tick see consistent readings, and the accelerometer is only read once.
+ */
+struct SensorFrame {
+    unsigned long time;
+    int x;
+    int y;
+    int z;
+    int mx;
+    int my;
+    int mz;
+
+    void sample(MicroBit &uBit) {
+        PROFILE_SCOPE(STAGE_ACCELEROMETER);
+        PROFILE_COUNT(COUNT_SENSOR_READS, 3);
+        time = uBit.systemTime();
+        x = uBit.accelerometer.getX();
+        y = uBit.accelerometer.getY();
+        z = uBit.accelerometer.getZ();
+    }
+
+    // The magnetometer is only needed while horizontal, so it is sampled separately.
+    void sampleMagnetometer(MicroBit &uBit) {
+        PROFILE_SCOPE(STAGE_COMPASS);
+        PROFILE_COUNT(COUNT_SENSOR_READS, 3);
+        mx = uBit.compass.getX();
+        my = uBit.compass.getY();
+        mz = uBit.compass.getZ();
+    }
+};
+
+/*
+ * Drains the accelerometer's FIFO in one I2C burst, on boards whose accelerometer has one.
+ * The FXOS8700 on v1.5 boards queues up to 32 samples, so the firmware can wake once per block rather than
+ * once per sample, and pays for one bus transaction per block. The MMA8653 on earlier boards has no FIFO,
+ * so begin() fails there and the caller reads sample by sample instead.
+ *
+ * The runtime's driver owns the same part, which is the compass too. It reads OUT_X_MSB whenever its data-ready
+ * interrupt fires or either sensor is read, and in FIFO mode each of those reads takes a sample out of the FIFO.
+ * So the FIFO is only on while nothing reads the sensors through the runtime, with the data-ready interrupt off
+ * to keep the driver idle, and stop() hands the part back. Setting either sensor's period through the runtime
+ * configures the part afresh, so setPeriod() must follow it to set the FIFO up again.
+ */
+#define FXOS8700_ADDRESS 0x3C // 8-bit I2C address, as the runtime gives it
+#define FXOS8700_ID 0xC7
+#define FXOS8700_F_STATUS 0x00
+#define FXOS8700_OUT_X_MSB 0x01
+#define FXOS8700_F_SETUP 0x09
+#define FXOS8700_WHO_AM_I 0x0D
+#define FXOS8700_CTRL_REG1 0x2A
+#define FXOS8700_CTRL_REG4 0x2D
+#define FIFO_COUNT_MASK 0x3F
+#define FIFO_MODE_CIRCULAR 0x40 // Keep the newest samples when the FIFO overflows
+#define FIFO_INT_ENABLE 0x40    // Interrupt at the watermark instead of on every sample
+#define CTRL_ACTIVE 0x01
+#define CTRL_DATA_READY 0x01    // The interrupt on every sample that the runtime's driver waits on
+#define FIFO_DEPTH 32
+#define FIFO_BLOCK 4            // Samples drained at a time
+class AccelerometerFifo {
+    private:
+        MicroBit &uBit;
+        unsigned long periodMs = 0;
+        unsigned long overflows = 0;
+        bool present = false;
+        bool on      = false;
+
+        // 14-bit samples are left-justified, at 4096 per g in the 2g range.
+        static int milliG(uint8_t const *bytes) {
+            return (((int16_t) (bytes[0] << 8 | bytes[1]) >> 2) * 1000) >> 12;
+        }
+
+        // The FIFO and interrupts can only be set up in standby.
+        void configure(uint8_t fifoSetup, uint8_t interrupts) {
+            uint8_t ctrl = 0;
+            uBit.i2c.readRegister(FXOS8700_ADDRESS, FXOS8700_CTRL_REG1, &ctrl, 1);
+            uBit.i2c.writeRegister(FXOS8700_ADDRESS, FXOS8700_CTRL_REG1, ctrl & ~CTRL_ACTIVE);
+            uBit.i2c.writeRegister(FXOS8700_ADDRESS, FXOS8700_F_SETUP, fifoSetup);
+            uBit.i2c.writeRegister(FXOS8700_ADDRESS, FXOS8700_CTRL_REG4, interrupts);
+            uBit.i2c.writeRegister(FXOS8700_ADDRESS, FXOS8700_CTRL_REG1, ctrl | CTRL_ACTIVE);
+        }
+    public:
+        AccelerometerFifo(MicroBit &uBit) : uBit(uBit) {}
+
+        /*
+         * Looks for the FIFO, leaving it off until start().
+         * @param periodMs the time between the accelerometer's samples
+         * @return false if the accelerometer has no FIFO
+         */
+        bool begin(unsigned long periodMs) {
+            this->periodMs = periodMs;
+            uint8_t id = 0;
+            if (uBit.i2c.readRegister(FXOS8700_ADDRESS, FXOS8700_WHO_AM_I, &id, 1) != MICROBIT_OK) return false;
+            present = id == FXOS8700_ID;
+            return present;
+        }
+
+        // Turns the FIFO on. Nothing may read the sensors through the runtime until stop().
+        void start() {
+            if (!present || on) return;
+            on = true;
+            configure(FIFO_MODE_CIRCULAR | FIFO_BLOCK, FIFO_INT_ENABLE);
+        }
+
+        // Turns the FIFO off, and the data-ready interrupt back on, the way the runtime's driver set them up.
+        void stop() {
+            if (!on) return;
+            on = false;
+            configure(0, CTRL_DATA_READY);
+        }
+
+        bool isOn() {
+            return on;
+        }
+
+        /*
+         * Reads every queued sample in one burst, and hands them to onSample oldest first.
+         * The part does not timestamp samples, so they are spaced a period apart, ending at now.
+         * @param onSample called with the time and the x, y and z acceleration in milli-g of each sample
+         * @return the number of samples drained
+         */
+        template <class F>
+        int drain(unsigned long now, F onSample) {
+            uint8_t raw[FIFO_DEPTH * 6];
+            const unsigned long period = periodMs; // onSample may change the rate
+            int queued;
+            {
+                PROFILE_SCOPE(STAGE_ACCELEROMETER);
+                uint8_t status = 0;
+                if (uBit.i2c.readRegister(FXOS8700_ADDRESS, FXOS8700_F_STATUS, &status, 1) != MICROBIT_OK) return 0;
+                queued = status & FIFO_COUNT_MASK;
+                if (queued == 0) return 0;
+                if (queued == FIFO_DEPTH) overflows++;
+                PROFILE_COUNT(COUNT_SENSOR_READS, 3 * queued);
+                if (uBit.i2c.readRegister(FXOS8700_ADDRESS, FXOS8700_OUT_X_MSB, raw, 6 * queued) != MICROBIT_OK) return 0;
+            }
+            for (int i = 0; i < queued; i++) {
+                onSample(now - (queued - 1 - i) * period, milliG(raw + 6 * i), milliG(raw + 6 * i + 2),
+                         milliG(raw + 6 * i + 4));
+            }
+            return queued;
+        }
+
+        // Call after the runtime's setPeriod of either sensor, which leaves the FIFO set up but the driver awake.
+        void setPeriod(unsigned long periodMs) {
+            this->periodMs = periodMs;
+            if (on) configure(FIFO_MODE_CIRCULAR | FIFO_BLOCK, FIFO_INT_ENABLE);
+        }
+
+        // Drains that found the FIFO full, so that samples may have been lost.
+        unsigned long getOverflows() {
+            return overflows;
+        }
+};
+
+/*
+ * Tells whether the board is lying still, from the variance of the squared magnitude of its acceleration.
+ * At rest the accelerometer sees only gravity and noise, so the magnitude barely varies whichever way up it is.
+ * The board goes still once the variance has stayed low for STILL_MS. It wakes on the first sample whose
+ * magnitude strays from the resting one, or that has tilted away from the resting direction, since turning
+ * the board slowly leaves the magnitude alone. Waking therefore takes a single sample, at whatever rate.
+ */
+#define MOTION_SCALE 10    // Squared magnitudes are taken in mg^2 / 2^MOTION_SCALE, about 1000 at 1g
+#define MOTION_SMOOTHING 3 // The mean and variance move 1/2^n of the way to each sample
+#define STILL_VARIANCE 400 // Below this the board might be still
+#define STILL_MS 2000      // How long the variance has to stay low before the board counts as still
+#define WAKE_DEVIATION 100 // A squared magnitude this far from the resting one wakes the board
+#define WAKE_TILT 150      // So does an acceleration this far, in mg summed over the axes, from the resting one
+class MotionDetector {
+    private:
+        bool started = false;
+        bool still   = false;
+        int32_t mean     = 0; // in 4 fractional bits
+        int32_t variance = 0;
+        unsigned long quietSince = 0;
+        int restX = 0, restY = 0, restZ = 0;
+    public:
+        /*
+         * @return true if the board went still or started moving on this sample
+         */
+        bool update(SensorFrame const& frame) {
+            const int32_t energy = Math::squaredMagnitude(frame.x, frame.y, frame.z) >> MOTION_SCALE;
+            if (!started) {
+                started = true;
+                mean = energy << 4;
+                quietSince = frame.time;
+                return false;
+            }
+            const int32_t deviation = energy - (mean >> 4);
+            if (still) {
+                const int tilt = Math::abs(frame.x - restX) + Math::abs(frame.y - restY) + Math::abs(frame.z - restZ);
+                if (Math::abs(deviation) <= WAKE_DEVIATION && tilt <= WAKE_TILT) return false;
+                still = false;
+                variance = deviation * deviation;
+                quietSince = frame.time;
+                return true;
+            }
+            mean += ((energy << 4) - mean) >> MOTION_SMOOTHING;
+            variance += (deviation * deviation - variance) >> MOTION_SMOOTHING;
+            if (variance > STILL_VARIANCE) quietSince = frame.time;
+            if (frame.time - quietSince < STILL_MS) return false;
+            still = true;
+            restX = frame.x;
+            restY = frame.y;
+            restZ = frame.z;
+            return true;
+        }
+
+        bool isStill() {
+            return still;
+        }
+};
+
 /*
  * Wrapper around a nullable value.
  * Provides a nicer way of handling null values.
@@ -143,16 +748,11 @@ struct Optional {
         T _value;
         bool _isNull;
     public:
-        Optional() {
-            _isNull = true;
-        }
+        constexpr Optional() : _value(), _isNull(true) {}
 
-        Optional(T value) {
-            _value = value;
-            _isNull = false;
-        }
-        
-        bool isNull() {
+        constexpr Optional(T const& value) : _value(value), _isNull(false) {}
+
+        constexpr bool isNull() const {
             return _isNull;
         }
 
@@ -161,354 +761,1133 @@ struct Optional {
         }
 
         /*
-         * Forcibly unwraps the Optional and returns the value stored.
-         * Returns void if the value is null.
+         * Forcibly unwraps the Optional and returns the value stored, without a copy.
+         * A null Optional holds a default constructed value.
          */
-        T _() {
-            if (!_isNull) return _value;
+        constexpr T const& _() const {
+            return _value;
         }
 
-        Optional<T> operator=(T value) {
+        // Copies are left to the compiler, so an Optional of a trivially copyable T is trivially copyable too.
+        Optional<T> &operator=(T const& value) {
             _value = value;
             _isNull = false;
-            return value;
-        }
-
-        Optional<T> operator=(Optional<T> other) {
-            _value = other._value;
-            _isNull = other._isNull;
-            return other;
+            return *this;
         }
 };
 
 /*
  * Wrapper around a value and a getRaw function that buffers a value.
- * Used to smooth out variations in data by waiting for bufferSize changes
- * in the raw data before registering a change in value.
+ * Used to smooth out variations in data by waiting until the raw data has differed
+ * from the value for windowMs before registering a change in value.
+ * The window is measured in time rather than ticks, so the response does not depend on the loop rate.
+ *
+ * getRaw is a template argument rather than a stored pointer, and onChange any callable, so both calls
+ * are direct and inline into value() like the rest of the code.
  * @param S the class of the instance to call for getRaw
  * @param T the type of value being buffered.
+ * @param (S::*getRaw)(SensorFrame const&) the member function that produces raw values
  */
-template <class S, typename T>
+template <class S, typename T, T (S::*getRaw)(SensorFrame const&)>
 class Buffer {
     private:
-        int changedCount = 0;
-        int bufferSize;
+        bool changing = false;
+        unsigned long changedSince = 0;
+        unsigned long windowMs;
         Optional<T> currentValue = Optional<T>();
         S *s;
-        T (S::*getRaw)();
     public:
         /*
-         * @param (S::*getRaw)() a function pointer to a member function of another object
+         * @param windowMs how long the raw data has to differ before the value changes
          * @param *s a pointer to the calling instance
          */
-        Buffer(int bufferSize, T (S::*getRaw)(), S *s) {
-            this->bufferSize = bufferSize;
+        Buffer(unsigned long windowMs, S *s) {
+            this->windowMs = windowMs;
             this->s = s;
-            this->getRaw = getRaw;
         }
 
-        T oldValue() {
-            if (currentValue.isNull()) return (*s.*getRaw)();
+        T oldValue(SensorFrame const& frame) {
+            if (currentValue.isNull()) return (*s.*getRaw)(frame);
             return currentValue._();
         }
 
-        T value(void (*onChange)()) {
-            T raw = (*s.*getRaw)();
+        template <class F>
+        T value(SensorFrame const& frame, F onChange) {
+            PROFILE_SCOPE(STAGE_FILTER);
+            T raw = (*s.*getRaw)(frame);
             if (currentValue.isNull()) {
                 currentValue = raw;
                 return raw;
             }
-            if (raw != currentValue._()) {
-                changedCount++;
-            } else {
-                changedCount = 0;
+            if (raw == currentValue._()) {
+                changing = false;
                 return currentValue._();
             }
-            if (changedCount > bufferSize) {
+            if (!changing) {
+                changing = true;
+                changedSince = frame.time;
+            }
+            if (frame.time - changedSince >= windowMs) {
+                changing = false;
                 currentValue = raw;
-                (*onChange)();
+                onChange();
             }
             return currentValue._();
         }
 
-        T value() {
-            return value([](){});
+        T value(SensorFrame const& frame) {
+            return value(frame, [](){});
         }
 
         void reset() {
-            int changedCount = 0;
+            changing = false;
             currentValue.toNull();
         }
 };
 
-
-// MARK 1: Question 1
-#define BUTTON_REPEAT_DELAY 500
-class TimeForEverything {
+/*
+ * A Buffer that takes a majority vote over the last N raw values, sampled evenly across windowMs.
+ * The value changes once more than half of the ring holds one other value.
+ * Each sample costs O(1) while the value holds half of the ring; the votes are only counted once it does not.
+ */
+template <class S, typename T, int N, T (S::*getRaw)(SensorFrame const&)>
+class MajorityBuffer {
     private:
-        int x = 5;
-        ButtonWrapper<TimeForEverything> buttonA = ButtonWrapper<TimeForEverything>(&uBit.buttonA, BUTTON_REPEAT_DELAY);
-        ButtonWrapper<TimeForEverything> buttonB = ButtonWrapper<TimeForEverything>(&uBit.buttonB, BUTTON_REPEAT_DELAY);
+        T ring[N];
+        int head = 0;
+        int filled = 0;
+        int dissent = 0; // number of values in the ring that differ from currentValue
+        unsigned long lastSlot = 0;
+        unsigned long slotMs;
+        Optional<T> currentValue = Optional<T>();
+        S *s;
 
-        void increment() {
-            if (x < 9) x++;
+        void push(T raw) {
+            if (filled == N) {
+                if (ring[head] != currentValue._()) dissent--;
+            } else {
+                filled++;
+            }
+            ring[head] = raw;
+            if (raw != currentValue._()) dissent++;
+            head = (head + 1) % N;
         }
 
-        void decrement() {
-            if (x > 1) x--;
+        int votes(T value) {
+            int count = 0;
+            for (int i = 0; i < filled; i++) {
+                if (ring[i] == value) count++;
+            }
+            return count;
         }
 
-        void countdown() {
-            while (x > 0) {
-                uBit.sleep(1000);
-                x--;
-                uBit.display.print(x);
+        void rescore() {
+            dissent = 0;
+            for (int i = 0; i < filled; i++) {
+                if (ring[i] != currentValue._()) dissent++;
             }
         }
     public:
-        void run() {
-            while (1) {
-                uBit.display.print(x);
-                if (uBit.buttonAB.isPressed()) {
-                    countdown();
+        MajorityBuffer(unsigned long windowMs, S *s) {
+            this->slotMs = windowMs / N;
+            this->s = s;
+        }
+
+        T oldValue(SensorFrame const& frame) {
+            if (currentValue.isNull()) return (*s.*getRaw)(frame);
+            return currentValue._();
+        }
+
+        template <class F>
+        T value(SensorFrame const& frame, F onChange) {
+            T raw = (*s.*getRaw)(frame);
+            if (currentValue.isNull()) {
+                currentValue = raw;
+                lastSlot = frame.time;
+                push(raw);
+                return raw;
+            }
+            if (frame.time - lastSlot < slotMs) return currentValue._();
+            lastSlot = frame.time;
+            push(raw);
+            if (2 * dissent > N) {
+                // Most of the ring disagrees, but it may be split between several values.
+                for (int i = 0; i < filled; i++) {
+                    if (2 * votes(ring[i]) <= N) continue;
+                    currentValue = ring[i];
+                    rescore();
+                    onChange();
                     break;
                 }
-                buttonA.onPress(&TimeForEverything::decrement, this);
-                buttonB.onPress(&TimeForEverything::increment, this);
             }
+            return currentValue._();
         }
-} timeForEverything;
 
-
-// MARK 2: Question 2a
-#define PERIMETER_LEN 18
-#define INDEX_BUFFER 100
-class VerticalParadox {
-    private:
-        Buffer<VerticalParadox, int> indexBuffer
-            = Buffer<VerticalParadox, int>(INDEX_BUFFER, &VerticalParadox::getRawIndex, this);
-
-        Optional<int> prevIndex       = Optional<int>();
-        Optional<int> currIndex       = Optional<int>();
-        Optional<int> initialIndex    = Optional<int>();
-        CircularDirection currUBitDir = NO_ROTATION; // direction of the uBit device, not the ring drawn
-
-        int getRawIndex() {
-            return (int) Math::degrees(uBit.accelerometer.getX(), uBit.accelerometer.getY()) / 20;
-        }
-
-        /*
-         * 0 represents the LED closest to buttonA.
-         * Every subsequent index wraps around the perimeter clockwise.
-         */
-        Coord getPixelCoord(int index) {
-            Coord c;
-            switch (index) {
-                case 0  : c.x = 0; c.y = 2; break;
-                case 1  : c.x = 0; c.y = 1; break;
-                case 2  : c.x = 0; c.y = 0; break;
-                case 3  : c.x = 1; c.y = 0; break;
-                case 4  : c.x = 2; c.y = 0; break;
-                case 5  : c.x = 3; c.y = 0; break;
-                case 6  : c.x = 4; c.y = 0; break;
-                case 7  : c.x = 4; c.y = 1; break;
-                case 8  : c.x = 4; c.y = 2; break;
-                case 9  : c.x = 4; c.y = 3; break;
-                case 10 : c.x = 4; c.y = 4; break;
-                case 11 : c.x = 3; c.y = 4; break;
-                case 12 : c.x = 2; c.y = 4; break;
-                case 13 : c.x = 1; c.y = 4; break;
-                case 14 : c.x = 0; c.y = 4; break;
-                case 15 : c.x = 0; c.y = 3; break;
-                case 16 : c.x = 0; c.y = 2; break;
-                case 17 : c.x = 0; c.y = 1; break;
-            }
-            return c;
-        }
-
-        // Set a pixel given an index of the ring around the perimeter.
-        void setImagePixel(int index) {
-            Coord c = getPixelCoord(index);
-            im.setPixelValue(c.x, c.y, 255);
-        }
-
-        // Draw the image required to print the ring around the perimeter.
-        void drawRing() {
-            if (currUBitDir != NO_ROTATION && Math::mod(currIndex._() + currUBitDir, PERIMETER_LEN) == initialIndex._()) return; 
-            int i = initialIndex._();
-            while (i != currIndex._()) {
-                setImagePixel(i);
-                i = Math::mod(i + currUBitDir, PERIMETER_LEN);
-            };
-            setImagePixel(i);
+        T value(SensorFrame const& frame) {
+            return value(frame, [](){});
         }
 
-        void printRing() {
-            im.clear();
-            drawRing();
-            uBit.display.print(im);
+        void reset() {
+            head = 0;
+            filled = 0;
+            dissent = 0;
+            currentValue.toNull();
         }
+};
 
-        void setCurrUBitDir() {
-            if (initialIndex._() == currIndex._()) return;
+/*
+ * A Buffer that reports the median of the last N raw values, sampled evenly across windowMs.
+ * Only meaningful for values that do not wrap around.
+ */
+template <class S, int N, int (S::*getRaw)(SensorFrame const&)>
+class MedianBuffer {
+    private:
+        int ring[N];
+        int sorted[N];
+        int head = 0;
+        int filled = 0;
+        unsigned long lastSlot = 0;
+        unsigned long slotMs;
+        Optional<int> currentValue = Optional<int>();
+        S *s;
 
-            CircularDirection flow = Circular::flow(prevIndex._(), initialIndex._(), currIndex._(), PERIMETER_LEN);
-            if (flow == CLOCKWISE) {
-                currUBitDir = CLOCKWISE;
-            } else if (flow == COUNTERCLOCKWISE) {
-                currUBitDir = COUNTERCLOCKWISE;
+        // Keeps sorted in order by moving the replaced value's slot to where raw belongs.
+        void push(int raw) {
+            int i;
+            if (filled == N) {
+                const int evicted = ring[head];
+                for (i = 0; sorted[i] != evicted; i++) {}
+                for (; i < N - 1; i++) sorted[i] = sorted[i + 1];
+                i = N - 1;
+            } else {
+                i = filled++;
             }
+            for (; i > 0 && sorted[i - 1] > raw; i--) sorted[i] = sorted[i - 1];
+            sorted[i] = raw;
+            ring[head] = raw;
+            head = (head + 1) % N;
         }
-
-        void setInitialIndex() {
-            if (initialIndex.isNull()) initialIndex = currIndex;
+    public:
+        MedianBuffer(unsigned long windowMs, S *s) {
+            this->slotMs = windowMs / N;
+            this->s = s;
         }
 
-        void setCurrentIndex() {
-            currIndex = indexBuffer.value();
+        int oldValue(SensorFrame const& frame) {
+            if (currentValue.isNull()) return (*s.*getRaw)(frame);
+            return currentValue._();
         }
 
-        void setPreviousIndex() {
-            if (currIndex._() == -1) {
-                prevIndex = indexBuffer.value();
-            } else {
-                prevIndex = currIndex;
+        template <class F>
+        int value(SensorFrame const& frame, F onChange) {
+            if (!currentValue.isNull() && frame.time - lastSlot < slotMs) return currentValue._();
+            lastSlot = frame.time;
+            push((*s.*getRaw)(frame));
+            const int median = sorted[(filled - 1) / 2];
+            if (currentValue.isNull()) {
+                currentValue = median;
+            } else if (median != currentValue._()) {
+                currentValue = median;
+                onChange();
             }
+            return median;
         }
 
-        void updateIndexes() {
-            setPreviousIndex();
-            setCurrentIndex();
-            setInitialIndex();
-        }
-    public:
-        void tick() {
-            updateIndexes();
-            setCurrUBitDir();
-            printRing();
+        int value(SensorFrame const& frame) {
+            return value(frame, [](){});
         }
 
         void reset() {
-            indexBuffer.reset();
-            currIndex.toNull();
-            initialIndex.toNull();
-            currUBitDir = NO_ROTATION;
+            head = 0;
+            filled = 0;
+            currentValue.toNull();
         }
-} vertParadox;
-
+};
 
-// MARK 3: Question 2b
-#define TILT_SENS 250   // Defines how sensitive the dot movement is to tilting. Lower values result in more sensitive movement.
-#define TILT_BUFFER 100 // How many data points before registering a change in tilt
-#define BLINK_DUR 250
-#define HEADING_BUFFER 100
-class HorizontalParadox {
-    private:
-        Buffer<HorizontalParadox, Coord> posBuffer
-            = Buffer<HorizontalParadox, Coord>(TILT_BUFFER, &HorizontalParadox::getRawPos, this);
+/*
+ * A Buffer that reports an exponential moving average of the raw values, with time constant tauMs.
+ * The average is kept in 8 fractional bits and weighted by the time between samples,
+ * so the response does not depend on the loop rate. Only meaningful for values that do not wrap around.
+ */
+#define EMA_SHIFT 8
+template <class S, int (S::*getRaw)(SensorFrame const&)>
+class EmaBuffer {
+    private:
+        int32_t average = 0;
+        unsigned long lastTime = 0;
+        unsigned long tauMs;
+        Optional<int> currentValue = Optional<int>();
+        S *s;
+    public:
+        EmaBuffer(unsigned long tauMs, S *s) {
+            this->tauMs = tauMs;
+            this->s = s;
+        }
 
-        Coord pos               = {0, 0};
-        unsigned long lastBlink = uBit.systemTime();
+        int oldValue(SensorFrame const& frame) {
+            if (currentValue.isNull()) return (*s.*getRaw)(frame);
+            return currentValue._();
+        }
 
-        Buffer<HorizontalParadox, int> headingBuffer
-            = Buffer<HorizontalParadox, int>(HEADING_BUFFER, &HorizontalParadox::getRawHeading, this);
+        template <class F>
+        int value(SensorFrame const& frame, F onChange) {
+            const int32_t raw = (int32_t) (*s.*getRaw)(frame) << EMA_SHIFT;
+            if (currentValue.isNull()) {
+                average = raw;
+                lastTime = frame.time;
+                currentValue = raw >> EMA_SHIFT;
+                return currentValue._();
+            }
+            const int32_t dt = frame.time - lastTime;
+            lastTime = frame.time;
+            average += (int32_t) ((int64_t) (raw - average) * dt / (int32_t) (tauMs + dt));
+            const int rounded = (average + (1 << (EMA_SHIFT - 1))) >> EMA_SHIFT;
+            if (rounded != currentValue._()) {
+                currentValue = rounded;
+                onChange();
+            }
+            return rounded;
+        }
 
-        Optional<int> prevHeading     = Optional<int>();
-        Optional<int> currHeading     = Optional<int>();
-        Optional<int> initialHeading  = Optional<int>();
-        CircularDirection currUBitDir = NO_ROTATION;
-        int turnCount                 = 0;
+        int value(SensorFrame const& frame) {
+            return value(frame, [](){});
+        }
 
-        Coord getRawPos() {
-            Coord pos = {
-                uBit.accelerometer.getX() / TILT_SENS,
-                uBit.accelerometer.getY() / TILT_SENS
-            };
-            return pos;
+        void reset() {
+            currentValue.toNull();
         }
+};
 
-        int getRawHeading() {
-            return uBit.compass.heading() / 20;
+/*
+ * Runs member functions of S as tasks at fixed rates.
+ * Between deadlines the fiber sleeps, so the runtime idles the CPU instead of spinning.
+ * Records, for each task, how many deadlines it missed and how late each run started.
+ * No more than MAX_TASKS are added; past that the id is -1, which wake and setPeriod ignore.
+ * @param S the class of the instance whose member functions are run
+ */
+#define MAX_TASKS 4
+#define SCHEDULER_IDLE_SLEEP 10 // ms slept while no task is armed, so that a handler can wake one
+template <class S>
+class Scheduler {
+    private:
+        struct Task {
+            void (S::*run)();
+            unsigned long periodMs; // 0 for a task that runs once each time it is woken
+            unsigned long deadline;
+            bool armed;
+            unsigned long runs;
+            unsigned long misses;
+            unsigned long totalJitter;
+            unsigned long maxJitter;
+        };
+        Task tasks[MAX_TASKS];
+        int taskCount = 0;
+        S *s;
+        MicroBit &uBit;
+
+        // The armed task with the earliest deadline, taking the first added on a tie, or NULL if none is armed.
+        Task *next() {
+            int earliest = -1;
+            for (int i = 0; i < taskCount; i++) {
+                if (!tasks[i].armed) continue;
+                if (earliest < 0 || (long) (tasks[i].deadline - tasks[earliest].deadline) < 0) earliest = i;
+            }
+            return earliest < 0 ? NULL : &tasks[earliest];
+        }
+    public:
+        Scheduler(S *s, MicroBit &uBit) : uBit(uBit) {
+            this->s = s;
         }
 
-        void drawTilt() {
-            unsigned long currTime = uBit.systemTime();
-            int brightness;
-            if (currTime - lastBlink > 2 * BLINK_DUR) {
-                lastBlink = currTime;
+        /*
+         * @param periodMs the time between deadlines of the task
+         * @param (S::*run)() the member function to run
+         * @return the id of the task, for setPeriod, or -1 if MAX_TASKS are already added
+         */
+        int every(unsigned long periodMs, void (S::*run)()) {
+            if (taskCount == MAX_TASKS) return -1;
+            Task task = {run, periodMs, uBit.systemTime(), true, 0, 0, 0, 0};
+            tasks[taskCount] = task;
+            return taskCount++;
+        }
+
+        /*
+         * Adds a task that only runs when woken, once for each wake. Every question keeps a periodic task too,
+         * so there is always a deadline to sleep towards.
+         * @param (S::*run)() the member function to run
+         * @return the id of the task, for wake, or -1 if MAX_TASKS are already added
+         */
+        int whenWoken(void (S::*run)()) {
+            if (taskCount == MAX_TASKS) return -1;
+            Task task = {run, 0, 0, false, 0, 0, 0, 0};
+            tasks[taskCount] = task;
+            return taskCount++;
+        }
+
+        // Runs a task added by whenWoken once, delayMs from now. Waking it again moves the deadline.
+        void wake(int task, unsigned long delayMs) {
+            if (task < 0) return;
+            tasks[task].deadline = uBit.systemTime() + delayMs;
+            tasks[task].armed = true;
+        }
+
+        /*
+         * Changes how often a task runs. A task that speeds up runs within its new period,
+         * rather than waiting out the deadline it had at the old one.
+         */
+        void setPeriod(int task, unsigned long periodMs) {
+            if (task < 0) return;
+            tasks[task].periodMs = periodMs;
+            const unsigned long latest = uBit.systemTime() + periodMs;
+            if ((long) (tasks[task].deadline - latest) > 0) tasks[task].deadline = latest;
+        }
+
+        // Sleeps until the next deadline, then runs the task it belongs to.
+        void runNext() {
+            Task *armed = next();
+            if (armed == NULL) {
+                uBit.sleep(SCHEDULER_IDLE_SLEEP);
+                return;
             }
-            if (currTime - lastBlink > BLINK_DUR) {
-                brightness = 255;
+            Task &task = *armed;
+            unsigned long now = uBit.systemTime();
+            if ((long) (task.deadline - now) > 0) {
+                uBit.sleep(task.deadline - now);
+                now = uBit.systemTime();
+            }
+            const unsigned long late = (long) (now - task.deadline) > 0 ? now - task.deadline : 0;
+            task.runs++;
+            task.totalJitter += late;
+            if (late > task.maxJitter) task.maxJitter = late;
+            if (task.periodMs == 0) {
+                task.armed = false;
             } else {
-                brightness = 0;
+                // Deadlines that passed while we were late are skipped rather than run back to back.
+                task.misses += late / task.periodMs;
+                task.deadline += (late / task.periodMs + 1) * task.periodMs;
             }
-            im.setPixelValue(2 + pos.x, 2 + pos.y, brightness);
+            (*s.*task.run)();
         }
 
-        void drawRotation() {
-            im.print('0' + turnCount);
+        void run() {
+            while (1) runNext();
         }
 
-        void printComposite() {
-            im.clear();
-            drawRotation();
-            drawTilt();
-            uBit.display.print(im);
+        // Writes each task's runs, missed deadlines and lateness to serial, as part of the profile.
+        void dump() {
+            for (int i = 0; i < taskCount; i++) {
+                const Task &task = tasks[i];
+                if (task.periodMs) uBit.serial.printf("task %d every %lu ms: ", i, task.periodMs);
+                else uBit.serial.printf("task %d when woken: ", i);
+                uBit.serial.printf("%lu runs, %lu deadlines missed, late %lu ms on average and %lu ms at worst\r\n",
+                                   task.runs, task.misses, task.runs ? task.totalJitter / task.runs : 0UL, task.maxJitter);
+            }
         }
+};
 
-        void setCurrUBitDir() {
-            if (initialHeading._() == currHeading._()) return;
-            CircularDirection flow = Circular::flow(prevHeading._(), initialHeading._(), currHeading._(), PERIMETER_LEN);
+enum ButtonId { BUTTON_A, BUTTON_B, BUTTON_COUNT };
 
-            if (flow == CLOCKWISE) {
-                // Left or passed through initialHeading in the clockwise direction
-                currUBitDir = CLOCKWISE;
-            } else if (flow == COUNTERCLOCKWISE) {
-                // Left or passed through initialHeading in the counter-clockwise direction
-                currUBitDir = COUNTERCLOCKWISE;
+/*
+ * Click, hold, auto-repeat and A+B chord gestures, worked out from the runtime's button down and up events.
+ * Handlers run from the message bus as the buttons change, so nothing polls the buttons, and input is seen
+ * whenever the fiber sleeps, whatever the question is doing. Only holds and repeats need a timer, which is
+ * a task on the question's scheduler that is woken while a button is down.
+ *
+ * A button released before holdMs clicks. One held for holdMs holds, then repeats every repeatMs until released.
+ * Pressing the second button while the first is down makes a chord instead, however long the first has been
+ * down or repeating, and neither button then clicks, holds or repeats until it is released.
+ * @param S the class of the instance whose member functions handle the gestures
+ */
+template <class S>
+class ButtonInput {
+    private:
+        struct Button {
+            void (S::*onClick)();
+            void (S::*onHold)();
+            void (S::*onRepeat)();
+            bool down;
+            bool chorded;
+            bool held;
+            unsigned long downAt;
+            unsigned long nextRepeat;
+        };
+        MicroBit &uBit;
+        S *s;
+        Scheduler<S> &scheduler;
+        Button buttons[BUTTON_COUNT];
+        void (S::*onChord)() = NULL;
+        unsigned long holdMs;
+        unsigned long repeatMs;
+        int timer = -1;
+
+        // Runs a gesture's handler, if bound, for the button edge or hold at ms.
+        void call(void (S::*handler)(), unsigned long ms) {
+            if (handler == NULL) return;
+#ifdef PROFILE
+            PROFILE_INPUT(ms);
+#else
+            (void) ms;
+#endif
+            (*s.*handler)();
+        }
+
+        // Wakes the timer for the next hold or repeat due on a button that is down.
+        void arm(unsigned long now) {
+            if (timer < 0) return;
+            bool due = false;
+            unsigned long earliest = 0;
+            for (int i = 0; i < BUTTON_COUNT; i++) {
+                const Button &b = buttons[i];
+                if (!b.down || b.chorded) continue;
+                if (b.held && b.onRepeat == NULL) continue;
+                const unsigned long at = b.held ? b.nextRepeat : b.downAt + holdMs;
+                if (!due || (long) (at - earliest) < 0) earliest = at;
+                due = true;
             }
+            if (due) scheduler.wake(timer, (long) (earliest - now) > 0 ? earliest - now : 0);
+        }
+
+        void onEvent(MicroBitEvent e) {
+            const int id = e.source == MICROBIT_ID_BUTTON_A ? BUTTON_A : BUTTON_B;
+            Button &b = buttons[id];
+            Button &other = buttons[BUTTON_COUNT - 1 - id];
+            // Time gestures from the edge, which may be a while before the handler runs if the fiber was busy.
+            const unsigned long edge = (unsigned long) (e.timestamp / 1000);
+            if (e.value == MICROBIT_BUTTON_EVT_DOWN) {
+                b.down = true;
+                b.chorded = false;
+                b.held = false;
+                b.downAt = edge;
+                if (other.down && !other.chorded) {
+                    b.chorded = true;
+                    other.chorded = true;
+                    call(onChord, edge);
+                }
+                arm(uBit.systemTime());
+            } else if (e.value == MICROBIT_BUTTON_EVT_UP && b.down) {
+                b.down = false;
+                if (!b.chorded && !b.held) call(b.onClick, edge);
+            }
+        }
+    public:
+        ButtonInput(MicroBit &uBit, S *s, Scheduler<S> &scheduler, unsigned long holdMs, unsigned long repeatMs)
+            : uBit(uBit), s(s), scheduler(scheduler), holdMs(holdMs), repeatMs(repeatMs) {
+            for (int i = 0; i < BUTTON_COUNT; i++) buttons[i] = Button();
         }
 
-        void checkTurns() {
-            if (currUBitDir == NO_ROTATION) return;
-            if (prevHeading._() == initialHeading._()) return;
+        /*
+         * @param button the button whose gestures to handle
+         * @param (S::*onClick)() run when the button is released before holdMs, or NULL
+         * @param (S::*onHold)() run once the button has been down for holdMs, or NULL
+         * @param (S::*onRepeat)() run when the button holds, and every repeatMs after until it is released, or NULL
+         */
+        void bind(ButtonId button, void (S::*onClick)(), void (S::*onHold)() = NULL, void (S::*onRepeat)() = NULL) {
+            buttons[button].onClick = onClick;
+            buttons[button].onHold = onHold;
+            buttons[button].onRepeat = onRepeat;
+        }
 
-            CircularDirection flow = Circular::flow(prevHeading._(), initialHeading._(), currHeading._(), PERIMETER_LEN);
-            if (flow == CLOCKWISE && currUBitDir == CLOCKWISE) {
-                // Touched initialHeading from the clockwise direction
-                turnCount++;
-                if (turnCount > 9) turnCount = 9;
-            } else if (flow == COUNTERCLOCKWISE && currUBitDir == COUNTERCLOCKWISE) {
-                // Touched initialHeading from the counter-clockwise direction
-                turnCount--;
-                if (turnCount < 0) turnCount = 0;
+        void bindChord(void (S::*onChord)()) {
+            this->onChord = onChord;
+        }
+
+        /*
+         * Starts listening for the buttons. Call once the object is at its final address.
+         * @param (S::*timer)() a member of S that calls onTimer, needed only if a hold or repeat is bound
+         */
+        void begin(void (S::*timer)() = NULL) {
+            if (timer != NULL) this->timer = scheduler.whenWoken(timer);
+            uBit.messageBus.listen(MICROBIT_ID_BUTTON_A, MICROBIT_EVT_ANY, this, &ButtonInput::onEvent);
+            uBit.messageBus.listen(MICROBIT_ID_BUTTON_B, MICROBIT_EVT_ANY, this, &ButtonInput::onEvent);
+        }
+
+        // Runs the holds and repeats that have come due.
+        void onTimer() {
+            const unsigned long now = uBit.systemTime();
+            for (int i = 0; i < BUTTON_COUNT; i++) {
+                Button &b = buttons[i];
+                if (!b.down || b.chorded) continue;
+                if (!b.held && now - b.downAt >= holdMs) {
+                    b.held = true;
+                    b.nextRepeat = b.downAt + holdMs;
+                    call(b.onHold, b.nextRepeat);
+                }
+                if (b.held && b.onRepeat != NULL && (long) (now - b.nextRepeat) >= 0) {
+                    const unsigned long due = b.nextRepeat;
+                    // Repeats missed while the fiber was busy are dropped rather than run back to back.
+                    while ((long) (now - b.nextRepeat) >= 0) b.nextRepeat += repeatMs;
+                    call(b.onRepeat, due);
+                }
             }
+            arm(now);
+        }
+};
+
+constexpr size_t maxOf(size_t a) {
+    return a;
+}
+
+template <class... Rest>
+constexpr size_t maxOf(size_t a, size_t b, Rest... rest) {
+    return maxOf(a > b ? a : b, rest...);
+}
+
+// The position of T in Ts. Naming a type that is not in Ts does not compile.
+template <class T, class... Ts>
+struct IndexOf;
+
+template <class T, class... Ts>
+struct IndexOf<T, T, Ts...> {
+    static constexpr int value = 0;
+};
+
+template <class T, class U, class... Ts>
+struct IndexOf<T, U, Ts...> {
+    static constexpr int value = 1 + IndexOf<T, Ts...>::value;
+};
+
+/*
+ * Static storage for objects of which at most one is alive at a time, such as the modes of a question.
+ * Nothing is constructed until it is first needed, and emplacing one type destroys the other first,
+ * so the arena costs as much RAM as the largest of Ts rather than all of them.
+ * @param Ts every type that can live in the arena
+ */
+template <class... Ts>
+class Arena {
+    private:
+        alignas(maxOf(alignof(Ts)...)) unsigned char storage[maxOf(sizeof(Ts)...)];
+        signed char active = -1; // index into Ts of the object alive in storage, or -1
+
+        template <class T>
+        static void destroyAs(void *object) {
+            static_cast<T *>(object)->~T();
         }
+    public:
+        Arena() {}
+        Arena(Arena const&) = delete;
+        Arena &operator=(Arena const&) = delete;
 
-        void setInitialHeading() {
-            if (initialHeading.isNull()) initialHeading = currHeading;
+        ~Arena() {
+            clear();
         }
 
-        void setCurrentHeading() {
-            currHeading = headingBuffer.value();
+        /*
+         * Destroys whatever is in the arena and constructs a T in its place.
+         * @param args passed on to the constructor of T
+         * @return the new T
+         */
+        template <class T, class... Args>
+        T &emplace(Args&&... args) {
+            clear();
+            T *object = new (storage) T(std::forward<Args>(args)...);
+            active = IndexOf<T, Ts...>::value;
+            return *object;
         }
 
-        void setPreviousHeading() {
-            if (currHeading.isNull()) {
-                prevHeading = headingBuffer.value();
+        // @return the T in the arena, or NULL if the arena holds something else
+        template <class T>
+        T *get() {
+            return active == IndexOf<T, Ts...>::value ? reinterpret_cast<T *>(storage) : NULL;
+        }
+
+        void clear() {
+            static void (*const destructors[])(void *) = {&Arena::destroyAs<Ts>...};
+            if (active >= 0) destructors[(int) active](storage);
+            active = -1;
+        }
+};
+
+
+// MARK 1: Question 1
+#define BUTTON_REPEAT_DELAY 500 // ms a button is held before it repeats
+#define BUTTON_REPEAT_PERIOD 500
+#define COUNTDOWN_STEP 1000
+#define SAMPLE_PERIOD 5  // 200 Hz
+#define LOGIC_PERIOD 10  // 100 Hz
+#define RENDER_PERIOD 20 // 50 Hz
+class TimeForEverything {
+    private:
+        MicroBit &uBit;
+        Renderer renderer;
+        int x = 5;
+        bool countingDown = false;
+        unsigned long lastStep = 0;
+        Scheduler<TimeForEverything> scheduler = Scheduler<TimeForEverything>(this, uBit);
+        ButtonInput<TimeForEverything> buttons = ButtonInput<TimeForEverything>(
+            uBit, this, scheduler, BUTTON_REPEAT_DELAY, BUTTON_REPEAT_PERIOD);
+
+        // Buttons are ignored once the countdown has started.
+        void increment() {
+            if (!countingDown && x < 9) x++;
+        }
+
+        void decrement() {
+            if (!countingDown && x > 1) x--;
+        }
+
+        void startCountdown() {
+            if (countingDown) return;
+            countingDown = true;
+            lastStep = uBit.systemTime();
+        }
+
+        void onButtonTimer() {
+            buttons.onTimer();
+        }
+
+        void print() {
+            renderer.commit(DIGITS[x]);
+        }
+
+        // Steps the countdown once a second, without blocking the other tasks.
+        void countdown() {
+            if (uBit.systemTime() - lastStep < COUNTDOWN_STEP) return;
+            lastStep += COUNTDOWN_STEP;
+            x--;
+#ifdef PROFILE
+            if (x == 0) {
+                profiler.dump(uBit);
+                scheduler.dump();
+            }
+#endif
+        }
+    public:
+        TimeForEverything(MicroBit &uBit) : uBit(uBit), renderer(uBit) {}
+
+        void tick() {
+            if (countingDown && x > 0) countdown();
+        }
+
+        void render() {
+            print();
+        }
+
+        void run() {
+            buttons.bind(BUTTON_A, &TimeForEverything::decrement, NULL, &TimeForEverything::decrement);
+            buttons.bind(BUTTON_B, &TimeForEverything::increment, NULL, &TimeForEverything::increment);
+            buttons.bindChord(&TimeForEverything::startCountdown);
+            buttons.begin(&TimeForEverything::onButtonTimer);
+            scheduler.every(LOGIC_PERIOD, &TimeForEverything::tick);
+            scheduler.every(RENDER_PERIOD, &TimeForEverything::render);
+            scheduler.run();
+        }
+};
+
+
+// MARK 2: Question 2a
+/*
+ * The tunable parameters of Question 2. Its classes take a configuration as a template parameter,
+ * so every value is a compile time constant folded into the code that uses it.
+ * host/tuner.cpp sweeps variants of this against labelled traces.
+ */
+struct Config {
+    static constexpr unsigned long INDEX_BUFFER       = 150;  // How long, in ms, the ring index has to change before it is registered
+    static constexpr int TILT_SENS                    = 250;  // Defines how sensitive the dot movement is to tilting. Lower values result in more sensitive movement.
+    static constexpr unsigned long TILT_BUFFER        = 150;  // How long, in ms, the tilt has to change before it is registered
+    static constexpr int GRAVITY_SMOOTHING            = 3;    // Gravity moves 1/2^n of the way to each new sample
+    static constexpr int FIELD_SMOOTHING              = 1;    // The magnetic field moves 1/2^n of the way to each new sample
+    static constexpr int ORIENTATION_SMOOTHING        = 3;    // Orienter's gravity moves 1/2^n of the way to each new sample
+    static constexpr int VERTICAL_TILT                = 55;   // Degrees from flat past which a flat board has stood up
+    static constexpr int HORIZONTAL_TILT              = 35;   // and below which a standing board has lain down
+    static constexpr int GRAVITY                      = 1250; // Readings with a magnitude greater than GRAVITY move Orienter's gravity more slowly
+};
+
+#define RING_RESOLUTION 1  // Ring indexes per LED around the perimeter
+#define RING_TABLE_BITS 8  // The angle to ring index table has 2^n entries
+
+/*
+ * The ring of LEDs around the edge of a W x H display, laid out by the compiler.
+ * Perimeter positions start at the top left LED and go clockwise. Ring indexes start at the LED closest
+ * to buttonA, the middle of the left edge, also go clockwise, and there are R of them to each LED.
+ * An angle points at the LED where a ray from the centre of the display at that angle leaves it,
+ * so a tilt towards a corner lights the corner whatever the layout.
+ */
+template <int W, int H, int R>
+struct RingGeometry {
+    static_assert(W >= 2 && H >= 2 && W * H <= 32, "the display must fit a Bitboard");
+    static_assert(R >= 1, "every LED needs at least one ring index");
+
+    static constexpr int LEDS   = 2 * (W + H) - 4;
+    static constexpr int LENGTH = LEDS * R;
+    static constexpr int H_MIDDLE = H / 2;
+    static constexpr int START  = 2 * (W - 1) + (H - 1) + (H - 1 - H_MIDDLE); // Perimeter position of ring index 0
+
+    static_assert(LENGTH < 256, "ring indexes are stored in a byte");
+    static_assert(LENGTH * 4 <= (1 << RING_TABLE_BITS), "the angle table must be finer than the ring");
+
+    static constexpr int x(int p) {
+        return p < W - 1               ? p
+             : p < W + H - 2           ? W - 1
+             : p < 2 * W + H - 3       ? W - 1 - (p - (W + H - 2))
+             :                           0;
+    }
+
+    static constexpr int y(int p) {
+        return p < W - 1               ? 0
+             : p < W + H - 2           ? p - (W - 1)
+             : p < 2 * W + H - 3       ? H - 1
+             :                           H - 1 - (p - (2 * W + H - 3));
+    }
+
+    static constexpr bool adjacent(int p, int q) {
+        return (x(p) - x(q)) * (x(p) - x(q)) + (y(p) - y(q)) * (y(p) - y(q)) == 1;
+    }
+
+    // Whether each perimeter position from p on is next to the one after it, all the way back round to 0.
+    static constexpr bool closedFrom(int p) {
+        return p == LEDS || (adjacent(p, (p + 1) % LEDS) && closedFrom(p + 1));
+    }
+
+    static constexpr Bitboard perimeterBit(int p) {
+        return (Bitboard) 1 << (y(p) * W + x(p));
+    }
+
+    static constexpr int perimeterOf(int index) {
+        return (index / R + START) % LEDS;
+    }
+
+    static constexpr Bitboard ringBit(int index) {
+        return perimeterBit(perimeterOf(index));
+    }
+
+    // The LEDs from index a to index b inclusive, going clockwise.
+    static constexpr Bitboard arcMask(int a, int b) {
+        return a == b ? ringBit(a) : ringBit(a) | arcMask((a + 1) % LENGTH, b);
+    }
+
+    static constexpr double circleSin(double a) {
+        return a < PI / 2     ? taylorSin(a)
+             : a < PI         ? taylorSin(PI - a)
+             : a < 3 * PI / 2 ? -taylorSin(a - PI)
+             :                  -taylorSin(2 * PI - a);
+    }
+
+    static constexpr double circleCos(double a) {
+        return circleSin(a < 3 * PI / 2 ? a + PI / 2 : a - 3 * PI / 2);
+    }
+
+    static constexpr double absolute(double v) {
+        return v < 0 ? -v : v;
+    }
+
+    // Steps from the centre along <dx, dy> to the edge, which is (W - 1) / 2 across and (H - 1) / 2 down.
+    static constexpr double stepsToEdge(double dx, double dy) {
+        return absolute(dx) * (H - 1) > absolute(dy) * (W - 1) ? (W - 1) / 2.0 / absolute(dx) : (H - 1) / 2.0 / absolute(dy);
+    }
+
+    // The perimeter position, in LEDs and not rounded, of the edge point at px, py.
+    static constexpr double perimeterAt(double px, double py) {
+        return py <= 0.0001          ? px
+             : px >= W - 1.0001      ? (W - 1) + py
+             : py >= H - 1.0001      ? (W - 1) + (H - 1) + (W - 1 - px)
+             :                         2 * (W - 1) + (H - 1) + (H - 1 - py);
+    }
+
+    // How far clockwise of ring index 0 a perimeter position is, from -0.5 to LEDS - 0.5.
+    static constexpr double fromStart(double position) {
+        return position - START < -0.5 ? position - START + LEDS
+             : position - START >= LEDS - 0.5 ? position - START - LEDS
+             : position - START;
+    }
+
+    static constexpr int indexAtPosition(double position) {
+        return (int) ((fromStart(position) + 0.5) * R);
+    }
+
+    // The ring index of the LED where <dx, dy> from the centre leaves the display.
+    static constexpr int indexToward(double dx, double dy) {
+        return indexAtPosition(perimeterAt((W - 1) / 2.0 + dx * stepsToEdge(dx, dy),
+                                           (H - 1) / 2.0 + dy * stepsToEdge(dx, dy)));
+    }
+
+    // Past the last LED, an angle is nearer ring index 0 again: index 0 of the next turn.
+    static constexpr int withinTurn(double a, int index) {
+        return a > PI && index < LENGTH / 2 ? index + LENGTH : index;
+    }
+
+    // Angle 0 points at ring index 0, on the left, and angles grow clockwise on the display, whose y axis points down.
+    static constexpr int indexAtAngle(double a) {
+        return withinTurn(a, indexToward(-circleCos(a), -circleSin(a)));
+    }
+
+    // The ring index for the middle of each of the 2^RING_TABLE_BITS slices of a turn.
+    static constexpr int indexAtSlice(int slice) {
+        return indexAtAngle((slice + 0.5) * 2 * PI / (1 << RING_TABLE_BITS));
+    }
+};
+
+typedef RingGeometry<BOARD_WIDTH, BOARD_HEIGHT, RING_RESOLUTION> BoardRing;
+#define PERIMETER_LEN BoardRing::LENGTH
+
+/*
+ * A geometry's arc masks for every pair of indexes, and its ring index for every slice of a turn,
+ * generated at compile time into flash.
+ */
+template <class G, class I>
+struct RingArcTable;
+
+template <class G, int... Is>
+struct RingArcTable<G, Indices<Is...> > {
+    static const Bitboard masks[sizeof...(Is)];
+};
+
+template <class G, int... Is>
+const Bitboard RingArcTable<G, Indices<Is...> >::masks[sizeof...(Is)] = {
+    G::arcMask(Is / G::LENGTH, Is % G::LENGTH)...
+};
+
+template <class G, class I>
+struct RingIndexTable;
+
+template <class G, int... Is>
+struct RingIndexTable<G, Indices<Is...> > {
+    static const uint8_t indexes[sizeof...(Is)];
+};
+
+template <class G, int... Is>
+const uint8_t RingIndexTable<G, Indices<Is...> >::indexes[sizeof...(Is)] = {
+    (uint8_t) G::indexAtSlice(Is)...
+};
+
+template <class G = BoardRing>
+class Ring {
+    public:
+        // An arc going clockwise from a to b, or anticlockwise from b to a.
+        static Bitboard arc(int a, int b) {
+            return RingArcTable<G, typename MakeIndices<G::LENGTH * G::LENGTH>::type>::masks[a * G::LENGTH + b];
+        }
+
+        // The ring index under a continuous angle, counting up past LENGTH with every turn.
+        static int unwrappedIndex(int32_t angle) {
+            return (angle >> 16) * G::LENGTH
+                 + RingIndexTable<G, typename MakeIndices<1 << RING_TABLE_BITS>::type>::indexes[
+                       (angle & (ANGLE_FULL - 1)) >> (16 - RING_TABLE_BITS)];
+        }
+    private:
+        static_assert(G::closedFrom(0), "the perimeter must go round the edge one LED at a time");
+        static_assert(G::x(G::START) == 0 && G::y(G::START) == G::H_MIDDLE, "ring index 0 must be the LED closest to buttonA");
+
+        Ring() {}
+};
+template <class C = Config>
+class VerticalParadox {
+    private:
+        Renderer &renderer;
+        RotationTracker tracker;
+        Optional<int> initialIndex = Optional<int>();
+        int currStep               = 0; // LEDs moved from initialIndex; positive when the uBit turned clockwise
+
+        int getRawStep(SensorFrame const& frame) {
+            (void) frame;
+            return Ring<>::unwrappedIndex(tracker.getAngle()) - initialIndex._();
+        }
+
+        Buffer<VerticalParadox, int, &VerticalParadox::getRawStep> stepBuffer
+            = Buffer<VerticalParadox, int, &VerticalParadox::getRawStep>(C::INDEX_BUFFER, this);
+
+        /*
+         * Draw the ring around the perimeter, from initialIndex to the current index in the direction of rotation.
+         * The ring clears just before it closes, and starts again from initialIndex.
+         */
+        Bitboard drawRing() {
+            const int length = Math::abs(currStep) % PERIMETER_LEN;
+            if (length == PERIMETER_LEN - 1) return 0;
+            // Starting just short of angle 0, the initial index is the first of the next turn.
+            const int initial = Math::mod(initialIndex._(), PERIMETER_LEN);
+            const int currIndex = Math::mod(initial + currStep, PERIMETER_LEN);
+            if (currStep >= 0) return Ring<>::arc(initial, currIndex);
+            return Ring<>::arc(currIndex, initial);
+        }
+
+        void printRing() {
+            renderer.commit(drawRing());
+        }
+
+        void updateIndexes(SensorFrame const& frame) {
+            uint16_t angle;
+            {
+                PROFILE_SCOPE(STAGE_ANGLE);
+                angle = Angle::of(frame.x, frame.y);
+            }
+            tracker.unwrap(angle);
+            if (initialIndex.isNull()) initialIndex = Ring<>::unwrappedIndex(tracker.getStart());
+            currStep = stepBuffer.value(frame);
+        }
+    public:
+        VerticalParadox(Renderer &renderer) : renderer(renderer) {}
+
+        void tick(SensorFrame const& frame) {
+            updateIndexes(frame);
+        }
+
+        void render() {
+            printRing();
+        }
+
+        int getStep() {
+            return currStep;
+        }
+};
+
+
+// MARK 3: Question 2b
+#define BLINK_DUR 250
+#define FIELD_LIMIT (1 << 15) // The field is scaled down below this on every axis before it is rotated
+
+/*
+ * Tilt-compensated heading from raw magnetometer and accelerometer samples, in fixed point.
+ * The board has no gyroscope, so the two sensors are split the way a complementary filter would:
+ * gravity is disturbed by every movement of the board and is smoothed heavily,
+ * while the magnetic field is not and is smoothed lightly, so turns come through quickly.
+ */
+template <class C = Config>
+class HeadingEstimator {
+    private:
+        bool started = false;
+        // Smoothed readings, with 4 fractional bits.
+        int32_t gx, gy, gz;
+        int32_t mx, my, mz;
+        // The two raw samples before of x, y, z, mx, my and mz.
+        int32_t older[6], old[6];
+
+        static int32_t smooth(int32_t average, int raw, int shift) {
+            return average + ((((int32_t) raw << 4) - average) >> shift);
+        }
+
+        // The median of the last three samples of an axis, so that a glitch in a single sample never reaches the heading.
+        int median(int axis, int raw) {
+            const int m = Math::median(older[axis], old[axis], raw);
+            older[axis] = old[axis];
+            old[axis] = raw;
+            return m;
+        }
+    public:
+        /*
+         * Rotates the magnetic field back to level using the roll and pitch from gravity, then takes its bearing.
+         * @return the heading in binary angle units, increasing clockwise
+         */
+        uint16_t update(SensorFrame const& frame) {
+            if (!started) {
+                started = true;
+                gx = frame.x << 4; gy = frame.y << 4; gz = frame.z << 4;
+                mx = frame.mx << 4; my = frame.my << 4; mz = frame.mz << 4;
+                const int raw[6] = {frame.x, frame.y, frame.z, frame.mx, frame.my, frame.mz};
+                for (int axis = 0; axis < 6; axis++) older[axis] = old[axis] = raw[axis];
             } else {
-                prevHeading = currHeading;
+                gx = smooth(gx, median(0, frame.x), C::GRAVITY_SMOOTHING);
+                gy = smooth(gy, median(1, frame.y), C::GRAVITY_SMOOTHING);
+                gz = smooth(gz, median(2, frame.z), C::GRAVITY_SMOOTHING);
+                mx = smooth(mx, median(3, frame.mx), C::FIELD_SMOOTHING);
+                my = smooth(my, median(4, frame.my), C::FIELD_SMOOTHING);
+                mz = smooth(mz, median(5, frame.mz), C::FIELD_SMOOTHING);
+            }
+            // The accelerometer reads -1g on z when flat, so gravity points the other way.
+            const int ax = -(gx >> 4), ay = -(gy >> 4), az = -(gz >> 4);
+            int bx = mx >> 4, by = my >> 4, bz = mz >> 4;
+            // Only the direction of the field matters. Halving it until every axis fits in 15 bits keeps the
+            // Q14 products below in 32 bits, and the level field within the 16 bits Angle::of takes,
+            // however strong the field is near a magnet.
+            while (Math::abs(bx) >= FIELD_LIMIT || Math::abs(by) >= FIELD_LIMIT || Math::abs(bz) >= FIELD_LIMIT) {
+                bx >>= 1; by >>= 1; bz >>= 1;
+            }
+
+            const uint16_t roll = Angle::of(az, ay);
+            const int sinRoll = Angle::sin(roll), cosRoll = Angle::cos(roll);
+            const uint16_t pitch = Angle::of((ay * sinRoll + az * cosRoll) >> 14, -ax);
+            const int sinPitch = Angle::sin(pitch), cosPitch = Angle::cos(pitch);
+
+            const int levelY = ((bz * sinRoll) >> 14) - ((by * cosRoll) >> 14);
+            const int levelX = ((bx * cosPitch) >> 14)
+                             + ((((by * sinRoll) >> 14) * sinPitch) >> 14)
+                             + ((((bz * cosRoll) >> 14) * sinPitch) >> 14);
+            return Angle::of(levelX, levelY);
+        }
+
+        void reset() {
+            started = false;
+        }
+};
+
+template <class C = Config>
+class HorizontalParadox {
+    private:
+        Renderer &renderer;
+        Coord pos               = {0, 0};
+        unsigned long frameTime = 0; // Blinking follows the sensor clock, so that replayed traces render the same
+        unsigned long lastBlink = 0;
+
+        HeadingEstimator<C> headingEstimator;
+        RotationTracker tracker;
+        int turnCount = 0;
+
+        bool posStarted         = false;
+        int8_t olderPos[2];               // The raw x and y positions of the two samples before
+        int8_t oldPos[2];
+
+        // The median of the last three positions on each axis, so that a glitch in a single sample
+        // neither moves the blinking LED nor resets the number.
+        Coord getRawPos(SensorFrame const& frame) {
+            const Coord raw = {
+                frame.x / C::TILT_SENS,
+                frame.y / C::TILT_SENS
+            };
+            if (!posStarted) {
+                posStarted = true;
+                olderPos[0] = oldPos[0] = (int8_t) raw.x;
+                olderPos[1] = oldPos[1] = (int8_t) raw.y;
+            }
+            const Coord pos = {
+                Math::median(olderPos[0], oldPos[0], raw.x),
+                Math::median(olderPos[1], oldPos[1], raw.y)
+            };
+            olderPos[0] = oldPos[0];
+            olderPos[1] = oldPos[1];
+            oldPos[0] = (int8_t) raw.x;
+            oldPos[1] = (int8_t) raw.y;
+            return pos;
+        }
+
+        Buffer<HorizontalParadox, Coord, &HorizontalParadox::getRawPos> posBuffer
+            = Buffer<HorizontalParadox, Coord, &HorizontalParadox::getRawPos>(C::TILT_BUFFER, this);
+
+        uint16_t getRawHeading(SensorFrame const& frame) {
+            PROFILE_SCOPE(STAGE_HEADING);
+            return headingEstimator.update(frame);
+        }
+
+        Bitboard drawTilt(Bitboard frame) {
+            unsigned long currTime = frameTime;
+            if (currTime - lastBlink > 2 * BLINK_DUR) {
+                lastBlink = currTime;
+            }
+            if (currTime - lastBlink > BLINK_DUR) {
+                return frame | pixelBit(2 + pos.x, 2 + pos.y);
             }
+            return frame & ~pixelBit(2 + pos.x, 2 + pos.y);
         }
 
-        void updateHeadings() {
-            setPreviousHeading();
-            setCurrentHeading();
-            setInitialHeading();
+        Bitboard drawRotation() {
+            return DIGITS[turnCount];
         }
 
-        void updateTilt() {
-            pos = posBuffer.value();
+        void printComposite() {
+            renderer.commit(drawTilt(drawRotation()));
+        }
+
+        // Count turns around the initial heading, clockwise up and anticlockwise down.
+        // A turn past 0 or 9 is dropped, and the tracker starts again from where the board is, so that
+        // every clockwise turn after it counts, and wobbling back across the hysteresis adds nothing.
+        void checkTurns(SensorFrame const& frame) {
+            tracker.unwrap(getRawHeading(frame));
+            turnCount += tracker.countTurns();
+            if (turnCount > 9 || turnCount < 0) {
+                turnCount = turnCount > 9 ? 9 : 0;
+                tracker.rebase();
+            }
+        }
+
+        void updateTilt(SensorFrame const& frame) {
+            pos = posBuffer.value(frame);
 
             if (pos.x > 2) pos.x = 2;
             if (pos.x < -2) pos.x = -2;
@@ -516,126 +1895,635 @@ class HorizontalParadox {
             if (pos.y < -2) pos.y = -2;
 
             if (Math::abs(pos.x) == 2 || Math::abs(pos.y) == 2) {
+                // Counting starts again from the heading the board leaves the edge at.
+                tracker.reset();
                 turnCount = 0;
             }
         }
     public:
-        void tick() {
-            updateTilt();
-            updateHeadings();
-            checkTurns();
-            setCurrUBitDir();
+        // @param now the sensor time the mode starts at, which starts the blink
+        HorizontalParadox(Renderer &renderer, unsigned long now) : renderer(renderer), frameTime(now), lastBlink(now) {}
+
+        void tick(SensorFrame const& frame) {
+            frameTime = frame.time;
+            // Turns first, so that a turn counted while the LED is at an edge never shows.
+            checkTurns(frame);
+            updateTilt(frame);
+        }
+
+        void render() {
             printComposite();
         }
 
-        void reset() {
-            posBuffer.reset();
-            pos = {0, 0};
-            lastBlink = uBit.systemTime();
-            headingBuffer.reset();
-            prevHeading.toNull();
-            currHeading.toNull();
-            initialHeading.toNull();
-            currUBitDir = NO_ROTATION;
-            turnCount = 0;
+        int getTurns() {
+            return turnCount;
         }
-} horiParadox;
+};
 
 
 // MARK 4: Switching between 2a and 2b
 /*
- * The margin of error for what we define as horizontal.
- *   |x, y| < HORI_TO_VERT_MARGIN: horizontal
- *   |x, y| > HORI_TO_VERT_MARGIN: vertical
- *   |z| < VERT_TO_HORI_MARGIN: vertical
- *   |z| > VERT_TO_HORI_MARGIN: horizontal
+ * Tells whether the board lies flat or stands up, from a low-pass gravity vector kept in fixed point.
+ * The tilt is the angle between gravity and the board's z axis, 0 when flat and a quarter turn when standing,
+ * and the two thresholds either side of 45 degrees give it hysteresis: a flat board stands up once the tilt
+ * passes VERTICAL_TILT, and lies down again once it drops below HORIZONTAL_TILT.
+ * Readings further from 1 g than GRAVITY is above it come from the board being moved or knocked.
+ * Rather than being thrown away, they move the estimate 2^JOLT_SLOWDOWN times more slowly.
  */
-#define HORI_TO_VERT_MARGIN 950
-#define VERT_TO_HORI_MARGIN 950
-#define GRAVITY 1250           // We ignore accelerometer readings with a magnitude greater than GRAVITY
-#define ORIENTATION_BUFFER 100 // Defines how many consecutive clean data points are captured before we register a change in verticality
+#define ORIENTATION_FRACTION 4 // Fractional bits of the smoothed gravity
+#define JOLT_SLOWDOWN 4
+#define ONE_G 1024             // mg the accelerometer reads at rest
 enum Orientation { HORIZONTAL = 0, VERTICAL = 1 };
+
+constexpr uint16_t angleOfDegrees(int degrees) {
+    return (uint16_t) ((int32_t) degrees * ANGLE_FULL / 360);
+}
+
+// sin^2 of an angle in whole degrees, with 15 fractional bits.
+constexpr int32_t squaredSinOfDegrees(int degrees) {
+    return (int32_t) (taylorSin(degrees * PI / 180) * taylorSin(degrees * PI / 180) * 32768 + 0.5);
+}
+
+template <class C = Config>
 class Orienter {
     private:
-        Buffer<Orienter, Orientation> orientationBuffer
-            = Buffer<Orienter, Orientation>(ORIENTATION_BUFFER, &Orienter::getRawOrientation, this);
+        static_assert(C::HORIZONTAL_TILT < C::VERTICAL_TILT && C::VERTICAL_TILT < 90,
+                      "the orientation thresholds must leave a hysteresis band below 90 degrees");
+        /*
+         * The tilt is past an angle when |x, y|^2 cos^2 > z^2 sin^2,
+         * so classifying takes no square root or arctangent.
+         */
+        static constexpr int32_t VERTICAL_SIN2   = squaredSinOfDegrees(C::VERTICAL_TILT);
+        static constexpr int32_t HORIZONTAL_SIN2 = squaredSinOfDegrees(C::HORIZONTAL_TILT);
 
         Orientation currOrientation = HORIZONTAL;
-        /*
-         * When VERTICAL, we check for horizontality by checking the magnitude of the vector <z>
-         *      0: perfectly vertical
-         *   1023: perfectly horizontal
-         * When HORIZONTAL, we check for verticality by checking the magnitude of the vector <x, y>
-         *      0: perfectly horizontal
-         *   1023: perfectly vertical
-         * This is so we can avoid issues with moving the uBit.
-         */
-        Orientation getRawOrientation() {
-            if (currOrientation == HORIZONTAL) {
-                if (Math::squaredMagnitude(uBit.accelerometer.getX(),
-                                           uBit.accelerometer.getY()) > HORI_TO_VERT_MARGIN * HORI_TO_VERT_MARGIN) {
-                    return VERTICAL;
-                }
-                return HORIZONTAL;
-            } else {
-                if (Math::abs(uBit.accelerometer.getZ()) > VERT_TO_HORI_MARGIN) {
-                    return HORIZONTAL;
-                }
-                return VERTICAL;
-            }
+        bool started = false;
+        int32_t gx = 0, gy = 0, gz = 0;
+
+        static int32_t smooth(int32_t average, int raw, int shift) {
+            return average + ((((int32_t) raw << ORIENTATION_FRACTION) - average) >> shift);
         }
 
-        bool largerThanGravity() {
-            return Math::squaredMagnitude(uBit.accelerometer.getX(),
-                                          uBit.accelerometer.getY(),
-                                          uBit.accelerometer.getZ()) > GRAVITY * GRAVITY;
+        static bool tiltedPast(int64_t radial2, int64_t axial2, int32_t sin2) {
+            return radial2 * (32768 - sin2) > axial2 * sin2;
         }
     public:
         Orientation getOrientation() {
             return currOrientation;
         }
 
-        void tick(void (*onChange)()) {
-            /*
-             * There are some flaws with using |z| or |x, y| to determine orientation.
-             * Moving the uBit along its z-axis will result in increased |z|, even when vertical.
-             * To mitigate this, we can ignore all readings where |x, y, z| > GRAVITY
-             */
-            if (largerThanGravity()) {
-                currOrientation = orientationBuffer.oldValue();
-            }
-            currOrientation = orientationBuffer.value(onChange);
+        // The smoothed tilt, in binary angle units from 0 (flat) to ANGLE_QUARTER (standing).
+        uint16_t getTilt() {
+            const int x = gx >> ORIENTATION_FRACTION, y = gy >> ORIENTATION_FRACTION;
+            return Angle::of(Math::abs(gz >> ORIENTATION_FRACTION), Math::isqrt(Math::squaredMagnitude(x, y)));
         }
-} orienter;
 
+        /*
+         * How sure the current orientation is, from 0 to 100: the share of the way the tilt is from the
+         * threshold that would flip it to flat or to standing, scaled down as the smoothed gravity strays from 1 g.
+         * Low while the board is near a threshold, or being moved.
+         */
+        int getConfidence() {
+            const int tilt = getTilt();
+            const int vertical = angleOfDegrees(C::VERTICAL_TILT), horizontal = angleOfDegrees(C::HORIZONTAL_TILT);
+            const int margin = currOrientation == HORIZONTAL ? vertical - tilt : tilt - horizontal;
+            const int range = currOrientation == HORIZONTAL ? vertical : ANGLE_QUARTER - horizontal;
+            const int share = margin <= 0 ? 0 : margin >= range ? 100 : margin * 100 / range;
+            const int x = gx >> ORIENTATION_FRACTION, y = gy >> ORIENTATION_FRACTION, z = gz >> ORIENTATION_FRACTION;
+            const int stray = Math::abs(Math::isqrt(Math::squaredMagnitude(x, y, z)) - ONE_G);
+            return stray >= ONE_G / 2 ? 0 : share * (ONE_G / 2 - stray) / (ONE_G / 2);
+        }
+
+        /*
+         * @param frame the sensors this tick
+         * @return true if the orientation changed
+         */
+        bool tick(SensorFrame const& frame) {
+            const Orientation lastOrientation = currOrientation;
+            if (!started) {
+                started = true;
+                gx = (int32_t) frame.x << ORIENTATION_FRACTION;
+                gy = (int32_t) frame.y << ORIENTATION_FRACTION;
+                gz = (int32_t) frame.z << ORIENTATION_FRACTION;
+            } else {
+                const int squared = Math::squaredMagnitude(frame.x, frame.y, frame.z);
+                const bool jolted = squared > C::GRAVITY * C::GRAVITY
+                                 || squared < (2 * ONE_G - C::GRAVITY) * (2 * ONE_G - C::GRAVITY);
+                const int shift = C::ORIENTATION_SMOOTHING + (jolted ? JOLT_SLOWDOWN : 0);
+                gx = smooth(gx, frame.x, shift);
+                gy = smooth(gy, frame.y, shift);
+                gz = smooth(gz, frame.z, shift);
+            }
+            const int x = gx >> ORIENTATION_FRACTION, y = gy >> ORIENTATION_FRACTION, z = gz >> ORIENTATION_FRACTION;
+            const int64_t radial2 = Math::squaredMagnitude(x, y), axial2 = (int64_t) z * z;
+            if (currOrientation == HORIZONTAL && tiltedPast(radial2, axial2, VERTICAL_SIN2)) currOrientation = VERTICAL;
+            if (currOrientation == VERTICAL && !tiltedPast(radial2, axial2, HORIZONTAL_SIN2)) currOrientation = HORIZONTAL;
+            return currOrientation != lastOrientation;
+        }
+};
 
 // MARK 5: Question 2 runner class
+#ifndef EVENT_DRIVEN_SAMPLING
+#define EVENT_DRIVEN_SAMPLING 1 // Tick on the sensors' data-ready events, rather than polling them every SAMPLE_PERIOD
+#endif
+#ifndef BURST_SAMPLING
+#define BURST_SAMPLING 1 // Drain the accelerometer's FIFO a block at a time, on boards that have one
+#endif
+#define ACCELEROMETER_PERIOD 10 // ms between accelerometer samples, 100 Hz
+#define COMPASS_PERIOD 20       // ms between compass samples, 50 Hz
+#define IDLE_PERIOD 80          // ms between samples of either sensor while the board lies still, 12.5 Hz
+#define IDLE_RENDER_PERIOD 50   // ms between redraws while the board lies still; the blink only changes every BLINK_DUR
+#define MAX_TURN_RATE 720       // degrees per second; nobody turns the board faster than two turns a second
+#define WAKE_LATENCY (2 * IDLE_PERIOD) // Worst case from the board moving to full rate: a sample, then a drain
+// Even before it wakes, a board sampled at the idle rate still tracks any turn a hand can make.
+static_assert(RotationTracker::maxTrackableRate(1000 / IDLE_PERIOD) >= MAX_TURN_RATE,
+              "turns would be lost at the idle sample rate");
+
+/*
+ * Keeps the compass calibration in flash, so that the user only has to roll the board around once
+ * rather than at every power up. A record with the wrong version, size or checksum, such as one
+ * from an older build or a write cut short, is ignored, and the compass calibrated again.
+ */
+#define CALIBRATION_KEY "paradoxCal"
+#define CALIBRATION_VERSION 1
+class CalibrationStore {
+    private:
+        struct Record {
+            CompassCalibration calibration;
+            uint8_t version;
+            uint8_t size;      // of CompassCalibration, in case the runtime changes its layout
+            uint16_t checksum; // Fletcher-16 of the bytes above
+        };
+        static_assert(sizeof(Record) <= MICROBIT_STORAGE_VALUE_SIZE, "the record must fit in one storage value");
+
+        MicroBit &uBit;
+
+        static uint16_t checksum(Record const& record) {
+            const uint8_t *bytes = (const uint8_t *) &record;
+            uint16_t a = 0, b = 0;
+            for (size_t i = 0; i < offsetof(Record, checksum); i++) {
+                a = (a + bytes[i]) % 255;
+                b = (b + a) % 255;
+            }
+            return (uint16_t) (b << 8 | a);
+        }
+    public:
+        CalibrationStore(MicroBit &uBit) : uBit(uBit) {}
+
+        /*
+         * Hands the stored calibration to the compass.
+         * @return false if there is no valid calibration stored
+         */
+        bool load() {
+            KeyValuePair *pair = uBit.storage.get(CALIBRATION_KEY);
+            if (pair == NULL) return false;
+            Record record;
+            memcpy(&record, pair->value, sizeof(record));
+            delete pair;
+            if (record.version != CALIBRATION_VERSION || record.size != sizeof(CompassCalibration)) return false;
+            if (record.checksum != checksum(record)) return false;
+            uBit.compass.setCalibration(record.calibration);
+            return true;
+        }
+
+        /*
+         * Stores the compass's current calibration.
+         * @return MICROBIT_OK, or the error from the storage
+         */
+        int save() {
+            Record record = Record();
+            record.calibration = uBit.compass.getCalibration();
+            record.version = CALIBRATION_VERSION;
+            record.size = sizeof(CompassCalibration);
+            record.checksum = checksum(record);
+            return uBit.storage.put(CALIBRATION_KEY, (uint8_t *) &record, sizeof(record));
+        }
+
+        /*
+         * Loads the stored calibration, so the board is ready straight away. Only when there is no valid one,
+         * or the user asks, is the compass calibrated again, and the result is only stored if calibrating
+         * succeeded, so an abandoned calibration never replaces a good one in flash.
+         * @param recalibrate calibrate even if a valid calibration is stored, or the compass already has one
+         */
+        void begin(bool recalibrate) {
+            if (!recalibrate && load()) return;
+            if ((recalibrate || !uBit.compass.isCalibrated()) && !uBit.compass.isCalibrating()) uBit.compass.calibrate();
+            if (uBit.compass.isCalibrated()) save();
+        }
+};
+
+template <class C = Config>
 class ParadoxThatDrivesUsAll {
+    private:
+        MicroBit &uBit;
+        Renderer renderer;
+        CalibrationStore calibrationStore;
+        AccelerometerFifo fifo;
+        MotionDetector motion;
+        Orienter<C> orienter;
+        // Only the mode for the current orientation exists; switching builds the other from scratch in its place.
+        Arena<VerticalParadox<C>, HorizontalParadox<C> > mode;
+        SensorFrame frame;
+        Scheduler<ParadoxThatDrivesUsAll> scheduler = Scheduler<ParadoxThatDrivesUsAll>(this, uBit);
+#ifdef PROFILE
+        ButtonInput<ParadoxThatDrivesUsAll> buttons = ButtonInput<ParadoxThatDrivesUsAll>(
+            uBit, this, scheduler, BUTTON_REPEAT_DELAY, BUTTON_REPEAT_PERIOD);
+
+        void dumpProfile() {
+            profiler.dump(uBit);
+            scheduler.dump();
+        }
+#endif
+        // Scheduler tasks whose rate follows the motion detector, or -1 for those not running.
+        int drainTask  = -1;
+        int sampleTask = -1;
+        int tickTask   = -1;
+        int renderTask = -1;
+        bool live = false; // reading the sensors, rather than replaying recorded frames
+
+        void sample() {
+            frame.sample(uBit);
+            if (orienter.getOrientation() == HORIZONTAL) frame.sampleMagnetometer(uBit);
+        }
+
+        void tick() {
+            PROFILE_SCOPE(STAGE_TICK);
+            PROFILE_COUNT(COUNT_TICKS, 1);
+            bool orientationChanged;
+            {
+                PROFILE_SCOPE(STAGE_ORIENTER);
+                orientationChanged = orienter.tick(frame);
+            }
+            if (orientationChanged) enter(orienter.getOrientation(), frame.time);
+            if (orienter.getOrientation() == VERTICAL) {
+                vertical().tick(frame);
+            } else {
+                horizontal().tick(frame);
+            }
+            if (motion.update(frame)) setRate(motion.isStill());
+        }
+
+        // Samples, ticks and redraws slowly while the board lies still, and at full rate as soon as it moves.
+        void setRate(bool still) {
+            const unsigned long accelerometerPeriod = still ? IDLE_PERIOD : ACCELEROMETER_PERIOD;
+            uBit.accelerometer.setPeriod(accelerometerPeriod);
+            uBit.compass.setPeriod(still ? IDLE_PERIOD : COMPASS_PERIOD);
+            fifo.setPeriod(accelerometerPeriod);
+            if (drainTask >= 0) scheduler.setPeriod(drainTask, drainPeriod());
+            if (sampleTask >= 0) scheduler.setPeriod(sampleTask, still ? IDLE_PERIOD : SAMPLE_PERIOD);
+            if (tickTask >= 0) scheduler.setPeriod(tickTask, still ? IDLE_PERIOD : LOGIC_PERIOD);
+            if (renderTask >= 0) scheduler.setPeriod(renderTask, still ? IDLE_RENDER_PERIOD : RENDER_PERIOD);
+        }
+
+        /*
+         * Builds the mode for a new orientation. The magnetometer is only read while the board lies flat,
+         * so on lying down the frame still holds the field from the last time it did; it is read afresh first,
+         * or the count would start from that old heading.
+         */
+        void enter(Orientation orientation, unsigned long now) {
+            if (drainTask >= 0) useFifo(orientation);
+            if (orientation == VERTICAL) {
+                mode.template emplace<VerticalParadox<C> >(renderer);
+            } else {
+                if (live) frame.sampleMagnetometer(uBit);
+                mode.template emplace<HorizontalParadox<C> >(renderer, now);
+            }
+        }
+
+        // Only standing up can the FIFO be on: lying flat needs the magnetometer, which is read through the runtime.
+        void useFifo(Orientation orientation) {
+            if (orientation == VERTICAL) fifo.start();
+            else fifo.stop();
+            scheduler.setPeriod(drainTask, drainPeriod());
+        }
+
+        // A block at a time from the FIFO, or a sample at a time without it. A drain per sample while still,
+        // so that the first sample to move is seen at once.
+        unsigned long drainPeriod() {
+            if (motion.isStill()) return IDLE_PERIOD;
+            return fifo.isOn() ? FIFO_BLOCK * ACCELEROMETER_PERIOD : ACCELEROMETER_PERIOD;
+        }
+
+        VerticalParadox<C> &vertical() {
+            return *mode.template get<VerticalParadox<C> >();
+        }
+
+        HorizontalParadox<C> &horizontal() {
+            return *mode.template get<HorizontalParadox<C> >();
+        }
+
+        // A fresh accelerometer sample is ready, so there is something new to tick on.
+        void onAccelerometerData(MicroBitEvent) {
+            frame.sample(uBit);
+            tick();
+        }
+
+        void onCompassData(MicroBitEvent) {
+            if (orienter.getOrientation() == HORIZONTAL) frame.sampleMagnetometer(uBit);
+        }
+
+        // Ticks on every sample the FIFO queued since the last block, or on a single sample while it is off.
+        void drain() {
+            if (!fifo.isOn()) {
+                sample();
+                tick();
+                return;
+            }
+            fifo.drain(uBit.systemTime(), [this](unsigned long time, int x, int y, int z) {
+                frame.time = time;
+                frame.x = x;
+                frame.y = y;
+                frame.z = z;
+                tick();
+            });
+        }
     public:
+        ParadoxThatDrivesUsAll(MicroBit &uBit) : uBit(uBit), renderer(uBit), calibrationStore(uBit), fifo(uBit) {
+            enter(orienter.getOrientation(), 0);
+        }
+
+        void render() {
+            if (orienter.getOrientation() == VERTICAL) {
+                vertical().render();
+            } else {
+                horizontal().render();
+            }
+        }
+
+        // Ticks on a recorded frame instead of the sensors, so that traces can be replayed.
+        void replay(SensorFrame const& recorded) {
+            frame = recorded;
+            tick();
+        }
+
+        Orientation getOrientation() {
+            return orienter.getOrientation();
+        }
+
+        // LEDs lit around the ring by Question 2a, or 0 while it is not running.
+        int getRingStep() {
+            VerticalParadox<C> *vertParadox = mode.template get<VerticalParadox<C> >();
+            return vertParadox != NULL ? vertParadox->getStep() : 0;
+        }
+
+        // Turns counted by Question 2b, or 0 while it is not running.
+        int getTurns() {
+            HorizontalParadox<C> *horiParadox = mode.template get<HorizontalParadox<C> >();
+            return horiParadox != NULL ? horiParadox->getTurns() : 0;
+        }
+
+        Bitboard getFrame() {
+            return renderer.getFrame();
+        }
+
+        bool isStill() {
+            return motion.isStill();
+        }
+
+        // ms between accelerometer samples at the current rate.
+        unsigned long getSamplePeriod() {
+            return motion.isStill() ? IDLE_PERIOD : ACCELEROMETER_PERIOD;
+        }
+
+        // Starts sampling, ticking and drawing, without running the scheduler.
+        void begin() {
+            // Holding A as the board starts calibrates the compass again.
+            calibrationStore.begin(uBit.buttonA.isPressed());
+            uBit.accelerometer.setPeriod(ACCELEROMETER_PERIOD);
+            uBit.compass.setPeriod(COMPASS_PERIOD);
+            // The first accelerometer event can come before the first compass one, and the count starts from the first tick.
+            frame.sampleMagnetometer(uBit);
+            bool burst = false;
+#if BURST_SAMPLING
+            burst = fifo.begin(ACCELEROMETER_PERIOD);
+#endif
+            if (burst) {
+                drainTask = scheduler.every(ACCELEROMETER_PERIOD, &ParadoxThatDrivesUsAll::drain);
+                useFifo(orienter.getOrientation());
+            } else {
+#if EVENT_DRIVEN_SAMPLING
+                uBit.messageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE,
+                                       this, &ParadoxThatDrivesUsAll::onAccelerometerData);
+                uBit.messageBus.listen(MICROBIT_ID_COMPASS, MICROBIT_COMPASS_EVT_DATA_UPDATE,
+                                       this, &ParadoxThatDrivesUsAll::onCompassData);
+#else
+                sampleTask = scheduler.every(SAMPLE_PERIOD, &ParadoxThatDrivesUsAll::sample);
+                tickTask = scheduler.every(LOGIC_PERIOD, &ParadoxThatDrivesUsAll::tick);
+#endif
+            }
+            renderTask = scheduler.every(RENDER_PERIOD, &ParadoxThatDrivesUsAll::render);
+#ifdef PROFILE
+            // Pressing A and B together dumps the profile.
+            buttons.bindChord(&ParadoxThatDrivesUsAll::dumpProfile);
+            buttons.begin();
+#endif
+            live = true;
+        }
+
+        // Sleeps until the next task is due and runs it, so that host tools can step a board started by begin.
+        void runNext() {
+            scheduler.runNext();
+        }
+
         void run() {
-            if (!uBit.compass.isCalibrated() && !uBit.compass.isCalibrating()) uBit.compass.calibrate();
-            while (1) {
-                orienter.tick([](){
-                    vertParadox.reset();
-                    horiParadox.reset();
-                });
-                if (orienter.getOrientation() == VERTICAL) {
-                    vertParadox.tick();
-                } else {
-                    horiParadox.tick();
+            begin();
+            scheduler.run();
+        }
+};
+
+
+// MARK 6: Trace recorder
+/*
+ * Streams every sensor sample over serial, so that sessions on a real board can be replayed on the host.
+ *
+ * The trace starts with the magic bytes "UBT" and a version byte, followed by one record per accelerometer sample:
+ *   header   0x50 | TRACE_KEYFRAME | TRACE_MAGNETOMETER | TRACE_BUTTON_B | TRACE_BUTTON_A
+ *   time     varint, ms since the previous record
+ *   x, y, z  zigzag varints, the change in each accelerometer axis
+ *   mx ...   zigzag varints, the change in each magnetometer axis, only if TRACE_MAGNETOMETER is set
+ * Keyframes hold absolute values instead of changes, and always carry the magnetometer.
+ * A still board costs 5 bytes per sample, so 100 Hz fits in a fraction of the serial line.
+ */
+#define TRACE_VERSION 1
+#define TRACE_BUTTON_A 0x01
+#define TRACE_BUTTON_B 0x02
+#define TRACE_MAGNETOMETER 0x04
+#define TRACE_KEYFRAME 0x08
+#define TRACE_HEADER 0x50
+#define TRACE_BUFFER 512          // Bytes of records held while the serial line catches up
+#define TRACE_RECORD_MAX 36       // Header, then at most seven 5 byte varints
+#define TRACE_TX_BUFFER 254       // Bytes the serial driver sends in the background
+#define TRACE_FLUSH_PERIOD 10     // ms between hand-offs to the serial driver
+#define TRACE_KEYFRAME_PERIOD 1000 // ms between keyframes, so that a reader can join a stream part way through
+#define TRACE_BAUD 115200
+class TraceRecorder {
+    private:
+        MicroBit &uBit;
+        Renderer renderer;
+        CalibrationStore calibrationStore;
+        SensorFrame frame;
+        SensorFrame last;
+        bool magnetometerFresh = false;
+        bool needKeyframe      = true;
+        unsigned long lastKeyframe = 0;
+
+        uint8_t buffer[TRACE_BUFFER];
+        int head = 0;
+        int used = 0;
+        unsigned long records = 0;
+        unsigned long dropped = 0;
+
+        Scheduler<TraceRecorder> scheduler = Scheduler<TraceRecorder>(this, uBit);
+
+        static int putVarint(uint8_t *out, uint32_t value) {
+            int n = 0;
+            while (value >= 0x80) {
+                out[n++] = (uint8_t) (value | 0x80);
+                value >>= 7;
+            }
+            out[n++] = (uint8_t) value;
+            return n;
+        }
+
+        // Zigzag encoding keeps small negative changes as short as small positive ones.
+        static int putSigned(uint8_t *out, int32_t value) {
+            return putVarint(out, ((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+        }
+
+        void record() {
+            const bool keyframe = needKeyframe || frame.time - lastKeyframe >= TRACE_KEYFRAME_PERIOD;
+            const bool magnetometer = keyframe || magnetometerFresh;
+            uint8_t out[TRACE_RECORD_MAX];
+            int n = 1;
+            out[0] = TRACE_HEADER
+                   | (keyframe ? TRACE_KEYFRAME : 0)
+                   | (magnetometer ? TRACE_MAGNETOMETER : 0)
+                   | (uBit.buttonB.isPressed() ? TRACE_BUTTON_B : 0)
+                   | (uBit.buttonA.isPressed() ? TRACE_BUTTON_A : 0);
+            if (keyframe) {
+                n += putVarint(out + n, frame.time);
+                n += putSigned(out + n, frame.x);
+                n += putSigned(out + n, frame.y);
+                n += putSigned(out + n, frame.z);
+                n += putSigned(out + n, frame.mx);
+                n += putSigned(out + n, frame.my);
+                n += putSigned(out + n, frame.mz);
+            } else {
+                n += putVarint(out + n, frame.time - last.time);
+                n += putSigned(out + n, frame.x - last.x);
+                n += putSigned(out + n, frame.y - last.y);
+                n += putSigned(out + n, frame.z - last.z);
+                if (magnetometer) {
+                    n += putSigned(out + n, frame.mx - last.mx);
+                    n += putSigned(out + n, frame.my - last.my);
+                    n += putSigned(out + n, frame.mz - last.mz);
                 }
             }
+
+            // Never wait on the serial line. If it has fallen behind, drop the sample, and start again from a keyframe.
+            if (TRACE_BUFFER - used < n) {
+                dropped++;
+                needKeyframe = true;
+                return;
+            }
+            for (int i = 0; i < n; i++) {
+                buffer[(head + used + i) % TRACE_BUFFER] = out[i];
+            }
+            used += n;
+            records++;
+            last = frame;
+            magnetometerFresh = false;
+            needKeyframe = false;
+            if (keyframe) lastKeyframe = frame.time;
+        }
+
+        // Hands as much as the serial driver will take, without blocking.
+        void flush() {
+            while (used > 0) {
+                const int chunk = head + used > TRACE_BUFFER ? TRACE_BUFFER - head : used;
+                const int sent = uBit.serial.send(buffer + head, chunk, ASYNC);
+                if (sent <= 0) return;
+                head = (head + sent) % TRACE_BUFFER;
+                used -= sent;
+                if (sent < chunk) return;
+            }
+        }
+
+        void onAccelerometerData(MicroBitEvent) {
+            frame.sample(uBit);
+            record();
+        }
+
+        void onCompassData(MicroBitEvent) {
+            frame.sampleMagnetometer(uBit);
+            magnetometerFresh = true;
+        }
+    public:
+        TraceRecorder(MicroBit &uBit) : uBit(uBit), renderer(uBit), calibrationStore(uBit) {}
+
+        unsigned long getRecords() {
+            return records;
+        }
+
+        unsigned long getDropped() {
+            return dropped;
         }
-} paradoxThatDrivesUsAll;
 
+        void run() {
+            // Holding A as the board starts calibrates the compass again.
+            calibrationStore.begin(uBit.buttonA.isPressed());
+            uBit.accelerometer.setPeriod(ACCELEROMETER_PERIOD);
+            uBit.compass.setPeriod(COMPASS_PERIOD);
+            uBit.serial.baud(TRACE_BAUD);
+            uBit.serial.setTxBufferSize(TRACE_TX_BUFFER);
+            frame.sampleMagnetometer(uBit);
+            const uint8_t magic[] = {'U', 'B', 'T', TRACE_VERSION};
+            uBit.serial.send((uint8_t *) magic, sizeof(magic), SYNC_SLEEP);
+
+            // A lone centre pixel shows that the board is recording.
+            renderer.commit(pixelBit(2, 2));
+            uBit.messageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE,
+                                   this, &TraceRecorder::onAccelerometerData);
+            uBit.messageBus.listen(MICROBIT_ID_COMPASS, MICROBIT_COMPASS_EVT_DATA_UPDATE,
+                                   this, &TraceRecorder::onCompassData);
+            scheduler.every(TRACE_FLUSH_PERIOD, &TraceRecorder::flush);
+            scheduler.run();
+        }
+};
+
+
+// MARK 7: main function
+/*
+ * Every class reaches the board through the MicroBit it was constructed with, so the only
+ * globals are the board and the questions running on it, and more than one can coexist on the host.
+ *
+ * Only one question runs at a time, so they share an arena and are built once the board is up.
+ * The budgets below are checked on every build. Sizes on the board are no larger than on a 64-bit host,
+ * so a build that passes on the host fits on the board too.
+ */
+#define MODE_RAM_BUDGET 192      // bytes for the mode arena of Question 2
+#define QUESTION_RAM_BUDGET 1024 // bytes for the question arena
+typedef Arena<TimeForEverything, ParadoxThatDrivesUsAll<>, TraceRecorder> Questions;
+static_assert(sizeof(Arena<VerticalParadox<>, HorizontalParadox<> >) <= MODE_RAM_BUDGET,
+              "Question 2's modes are over their RAM budget");
+static_assert(sizeof(Questions) <= QUESTION_RAM_BUDGET, "the questions are over their RAM budget");
+
+MicroBit uBit;
+Questions questions;
 
-// MARK 6: main function
 int main() {
     uBit.init();
 
-    // Uncomment the lines below to test each question
-    // timeForEverything.run();
-    paradoxThatDrivesUsAll.run();
+    // Each question runs its scheduler in a fiber of its own. Build with -DQUESTION_1 to test Question 1.
+#if defined(QUESTION_1)
+    create_fiber([](){ questions.emplace<TimeForEverything>(uBit).run(); });
+#elif defined(RECORD_TRACE)
+    create_fiber([](){ questions.emplace<TraceRecorder>(uBit).run(); });
+#else
+    create_fiber([](){ questions.emplace<ParadoxThatDrivesUsAll<> >(uBit).run(); });
+#endif
 
     release_fiber();
+    // release_fiber() does not return on the board; the host tools include this file with main renamed.
+    return 0;
 }